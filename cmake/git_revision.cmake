@@ -0,0 +1,22 @@
+# run by the mandelbrot_revision target on every build, usage:
+#   cmake -DSOURCE_DIR=<repo> -DOUTPUT=<header> -P git_revision.cmake
+# the header is only rewritten when the revision changes, so an unchanged tree rebuilds nothing
+find_package(Git QUIET)
+if(GIT_FOUND)
+    execute_process(COMMAND ${GIT_EXECUTABLE} describe --always --dirty
+        WORKING_DIRECTORY ${SOURCE_DIR}
+        OUTPUT_VARIABLE revision
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        ERROR_QUIET)
+endif()
+if(NOT revision)
+    set(revision "unknown")
+endif()
+
+set(contents "#define GIT_REVISION \"${revision}\"\n")
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} old_contents)
+endif()
+if(NOT contents STREQUAL old_contents)
+    file(WRITE ${OUTPUT} "${contents}")
+endif()
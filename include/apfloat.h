@@ -0,0 +1,37 @@
+#ifndef APFLOAT_H
+#define APFLOAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// fixed point, sign + magnitude
+// limb[APFLOAT_LIMBS - 1] holds the integer part, the rest are 32 bit fraction limbs (little-endian)
+// 7 fraction limbs resolve ~1e-67, enough for reference orbits down to a zoom of ~1e-50
+#define APFLOAT_LIMBS 8
+
+struct apfloat {
+    bool negative;
+    uint32_t limb[APFLOAT_LIMBS];
+};
+
+void ap_from_double(struct apfloat* out, double x);
+double ap_to_double(const struct apfloat* a);
+
+// parses a plain decimal such as "-1.401155189092050600", returns false on malformed input
+bool ap_from_string(struct apfloat* out, const char* str);
+
+// out may alias either operand
+void ap_add(struct apfloat* out, const struct apfloat* a, const struct apfloat* b);
+void ap_sub(struct apfloat* out, const struct apfloat* a, const struct apfloat* b);
+void ap_mul(struct apfloat* out, const struct apfloat* a, const struct apfloat* b);
+void ap_add_double(struct apfloat* out, const struct apfloat* a, double x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <stdbool.h>
+
+// timings of one benchmark scene over its repeated runs, and the run settings they were taken with, written
+// out for tools rather than people
+//
+// .csv files get a header and one row per scene, the settings repeated on each; anything else is a JSON
+// object with the settings and a "scenes" array, each scene keeping its runs as well as their statistics
+
+// summary of a scene's runs, in ms
+struct BenchStats {
+    int runs;
+    double min, median, p95, mean, stddev;  // p95 by nearest rank, stddev of the sample (0 for one run)
+};
+
+struct BenchSceneResult {
+    const char* name;
+    const char* precision;  // what the scene rendered in
+    double* runs_ms;
+    struct BenchStats stats;
+    long long iterations;  // z^2 + c steps a run takes, for the rate
+    long long lane_steps;  // steps taken by every SIMD lane, busy or idle, for the lane efficiency
+    long long inside;      // pixels answered by the cardioid and bulb test
+    long long periodic;    // pixels the periodicity check stopped short of the limit
+};
+
+struct BenchReport {
+    long threads;
+    const char* simd_target;  // Highway target dynamic dispatch picked, "none" for --scalar
+    const char* precision;    // forced precision, or "auto"
+    const char* mode;         // smooth or fast
+    const char* scene_set;
+    int width, height;
+    int warmup, repeats;
+    struct BenchSceneResult* scenes;
+    int scene_count;
+};
+
+void bench_stats(const double* runs_ms, int count, struct BenchStats* out);
+
+// commit the binary was configured from, "unknown" outside a git checkout
+const char* bench_revision(void);
+
+// returns 0 on success
+int bench_write_report(const char* path, const struct BenchReport* report);
+
+// regression gate: a baseline keeps each scene's runs and the settings, compared scene by scene against a later
+// report. a scene has regressed when its median is more than threshold (0.05 for 5%) slower and a one-sided
+// Mann-Whitney U test puts the chance of the shift being noise under BENCH_SIGNIFICANCE; with fewer than
+// BENCH_MIN_RUNS runs on either side the test can't reach that, and the median alone decides
+#define BENCH_SIGNIFICANCE 0.05
+#define BENCH_MIN_RUNS 3
+
+// returns 0 on success
+int bench_save_baseline(const char* path, const struct BenchReport* report);
+
+// prints the comparison, returns 0 when no scene regressed and 1 when one did or the baseline can't be read
+int bench_compare(const char* path, const struct BenchReport* report, double threshold);
+
+#endif
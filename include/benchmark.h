@@ -7,9 +7,31 @@ struct BenchmarkOpts {
     bool smooth;
     bool scalar;
     bool sweep;
+    bool kernels;             // time the double SIMD kernel alone on every target instead, see run_kernel_bench()
+    const char* simd_target;  // the one target --simd-target forced, NULL for all of them
     bool no_optimisations;
+    int tile_size;
+    bool deep;      // perturbation scenes instead of the standard set
+    bool mid;       // mid-depth scenes for comparing double against double-double
+    int precision;  // enum Precision forced for every scene, -1 picks per scene
+    bool mariani_silver;
+    bool solid_guess;
+    bool progressive;  // 8 -> 4 -> 2 -> 1 passes as in the viewer, guessing needs them
+    int aa_samples;    // adaptive anti-aliasing, extra samples per edge pixel (see AA_PASS)
+    int aa_budget;     // extra samples per frame, 0 allows one per pixel
+    int warmup;        // untimed runs of each scene before its timed ones
+    int repeats;       // timed runs of each scene, summarised by their median
+    const char* report;  // JSON or CSV file for the timings (see bench_report.h), NULL for none
+    const char* save_baseline;  // file to keep this run's timings in for a later compare
+    const char* compare;        // baseline to check this run against
+    double threshold;           // slowdown past which a scene regresses, 0.05 for 5%
 };
 
-void run_benchmark(struct BenchmarkOpts opts);
+// returns 0 on success, 1 on failure or when a scene regressed against opts.compare
+int run_benchmark(struct BenchmarkOpts opts);
 void run_sweep(struct BenchmarkOpts opts);
+
+// SimdRow on fixed rows of a few views, once for each compiled target this CPU can run and once for the scalar
+// loop, single threaded and without colouring, in ns per iteration; leaves dispatch on the best target
+int run_kernel_bench(struct BenchmarkOpts opts);
 #endif
\ No newline at end of file
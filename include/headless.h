@@ -0,0 +1,39 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdbool.h>
+
+// still image rendered without a window, streamed to a file one band of rows at a time
+struct HeadlessOpts {
+    const char* output;  // .ppm for binary PPM, anything else is written as PNG
+    int width, height;
+    const char* centre_x;  // decimal strings so deep centres keep every digit
+    const char* centre_y;
+    double zoom;     // world units per output pixel
+    int iterations;
+    int palette;     // index into list_palettes
+    bool smooth;
+    int threads;     // 0 uses every logical core
+    int tile_size;
+    int band_rows;   // rows rendered per band, which bounds memory use
+    int poster_tile;  // edge of a tile of a run_poster() file
+    const char* keyframes;  // run_animation() path, see read_keyframes()
+    int frames;
+    int precision;   // enum Precision forced for the whole image, -1 picks from the zoom
+    bool mariani_silver;
+    int aa_samples;  // adaptive anti-aliasing, see AA_PASS
+    int aa_budget;
+};
+
+// returns 0 on success
+int run_headless(struct HeadlessOpts opts);
+
+// the same image rendered into a memory-mapped tiled file (see tiled_image.h) at output instead, for sizes whose
+// rows don't fit in memory; running it again with the same settings skips the tiles a cut short run finished
+int run_poster(struct HeadlessOpts opts);
+
+// frames along a keyframe path of centres and zooms, output being a pattern such as zoom_%05d.png for the
+// frame number; centre and zoom come from the keyframes, and iterations, when not given, from each frame's zoom
+int run_animation(struct HeadlessOpts opts);
+
+#endif
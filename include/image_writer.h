@@ -0,0 +1,34 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <SDL3/SDL_stdinc.h>  // for Uint32
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// streams an RGB image to disk a band of rows at a time, so the whole image never has to be in memory
+//
+// .ppm files are binary PPM (P6). anything else is written as a PNG whose pixel data is stored
+// uncompressed: each band becomes one IDAT chunk holding the next stored deflate blocks of a single
+// zlib stream, which needs no compression library and no look-ahead beyond the band itself
+struct ImageWriter {
+    FILE* file;
+    bool png;
+    int width, height;
+    int rows_written;
+    unsigned char* row;  // one row of output bytes (PNG filter byte + RGB)
+    uint32_t crc;        // of the open chunk
+    uint32_t adler_a, adler_b;
+    int block_left;  // bytes left in the open stored block
+};
+
+// returns NULL, after reporting why, when the file can't be created
+struct ImageWriter* image_open(const char* path, int width, int height);
+
+// rows of 0xAARRGGBB pixels, width apart; alpha is dropped. returns 0 on success
+int image_write_rows(struct ImageWriter* w, const Uint32* pixels, int rows);
+
+// finishes the file and frees the writer, returns 0 on success
+int image_close(struct ImageWriter* w);
+
+#endif
@@ -1,9 +1,14 @@
 #ifndef MANDELBROT_VIEW
 #define MANDELBROT_VIEW
 
+#include "apfloat.h"
+
 #include <SDL3/SDL.h>
 #include <stdbool.h>
 
+// deepest zoom the full precision centre can resolve (see APFLOAT_LIMBS)
+#define MIN_ZOOM 1e-50
+
 struct viewport {
     int screen_width;
     int screen_height;
@@ -12,12 +17,22 @@ struct viewport {
     float drag_start_x;
     float drag_start_y;
 
+    // centre of the screen; the doubles are rounded copies of centre_x/centre_y
     double current_offset_x;
     double current_offset_y;
 
     double initial_offset_x;
     double initial_offset_y;
 
+    // full precision centre for deep zooms, and the part of it current_offset_x/y dropped
+    // (current_offset + offset_lo is the centre as a double-double)
+    double offset_lo_x;
+    double offset_lo_y;
+    struct apfloat centre_x;
+    struct apfloat centre_y;
+    struct apfloat initial_centre_x;
+    struct apfloat initial_centre_y;
+
     double zoom;
 
     int iterations;
@@ -25,6 +40,7 @@ struct viewport {
 };
 
 struct viewport* init_viewport(int width, int height);
+void set_viewport_centre(struct viewport* vp, const struct apfloat* x, const struct apfloat* y);
 void ZoomOnMouse(struct viewport* vp, double zoom_factor);
 bool handle_mouse_events(SDL_Event* event, struct viewport* state);
 
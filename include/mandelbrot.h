@@ -2,13 +2,14 @@
 #define MANDELBROT_CALC
 
 #include <SDL3/SDL_stdinc.h>  // for Uint32 type
-#include <pthread.h>
 #include <stdbool.h>
 
 #if defined(_MSC_VER) || defined(__cplusplus)
 #define ATOMIC_BOOL volatile bool
+#define ATOMIC_INT volatile int
 #else
 #define ATOMIC_BOOL _Atomic bool
+#define ATOMIC_INT _Atomic int
 #endif
 
 #ifdef __cplusplus
@@ -16,32 +17,151 @@ extern "C" {
 #endif
 
 struct viewport;
+struct Perturbation;
+
+// arithmetic used for a frame, see select_precision()
+enum Precision {
+    PRECISION_DOUBLE,
+    PRECISION_FLOAT,          // float32 SIMD lanes, shallow zoom only
+    PRECISION_DOUBLE_DOUBLE,  // hi + lo pairs of doubles in SIMD lanes, mid-depth zoom
+    PRECISION_PERTURBATION,   // high precision reference orbit with double deltas, see perturbation.h
+};
+
+// the only pass of a frame that just recolours the last one's counts, see ThreadPool
+#define RECOLOUR_PASS -1
+
+// reprojection stage of a zoom: before its first pass the frame is filled with a resampled copy of the last
+// finished frame, so there is a preview at once; passes then skip pixels whose source was the same sample
+#define REPROJECT_PASS 0  // render fraction the pool queues for that stage
+
+enum ReprojectKind {
+    REPROJECT_NONE,     // no source, or already sampled by a pass of this frame
+    REPROJECT_PREVIEW,  // nearest source pixel, shown until the pass that samples it
+    REPROJECT_EXACT,    // source was this pixel's own point, its count is final
+};
+
+struct Reprojection {
+    const int* source;  // counts of the last finished frame
+    int width, height;
+    double x0, y0, scale;  // pixel (x, y) lies on source pixel (x0 + x * scale, y0 + y * scale)
+    bool exact;            // the source used the same arithmetic, so matching samples can be reused
+    int exact_limit;       // ... when their count is below this
+    unsigned char* kind;   // enum ReprojectKind per screen pixel
+};
+
+// the only pass of a frame that raises the last one's iteration limit: pixels that escaped keep their counts,
+// those that reached the old limit carry on from their saved orbits (see OrbitStore)
+#define RESUME_PASS -2
+
+// orbit of a pixel at its frame's iteration limit, enough to carry on iterating it under a higher one
+struct OrbitState {
+    double cx;          // real part of c as first computed, so carrying on repeats the same arithmetic
+    double x, y;        // z after iterations steps
+    double oldx, oldy;  // last periodicity check snapshot
+    int iterations;     // below the limit when the pixel was shown to be inside instead
+};
+
+#define ORBIT_NONE -1    // nothing saved, the pixel starts again from z = 0
+#define ORBIT_INSIDE -2  // inside the set, at the limit whatever it is raised to
+
+// work the kernels actually did, added to by every row they compute
+struct IterationCounts {
+    long long iterations;  // z^2 + c steps taken, by pixels that needed them
+    long long lane_steps;  // steps taken by every lane, busy or idle; a scalar kernel is one lane that is always busy
+    long long inside;      // pixels answered by the cardioid and bulb test without iterating
+    long long periodic;    // pixels the periodicity check stopped short of the limit
+};
+
+// orbits of the finished frame's pixels that reached its limit, filled in while it renders; bounded by
+// capacity, pixels past it are dropped and start again from z = 0
+struct OrbitStore {
+    int* slot;  // per screen pixel: index into states, ORBIT_NONE or ORBIT_INSIDE
+    struct OrbitState* states;
+    int capacity;
+    ATOMIC_INT used;
+    ATOMIC_INT dropped;
+};
+
+// adaptive anti-aliasing once a frame is at full resolution: AA_DETECT_PASS counts the edge pixels, whose count
+// differs sharply from a neighbour's, and AA_PASS averages jittered subsamples into just those, as many each as
+// the frame's sample budget allows when spread evenly over them
+#define AA_DETECT_PASS -3
+#define AA_PASS -4
+#define AA_MAX_SAMPLES 64  // extra samples per edge pixel
+
+// the only pass of a frame that adds one more jittered sample of every pixel of the last, unchanged view to a
+// running average, so a still view converges to an anti-aliased image while the viewer is idle
+#define ACCUMULATE_PASS -5
 
 struct RenderJob {
     int start_y, end_y, scrn_width;
+    int start_x, end_x;
     struct viewport* vp;
     Uint32* palette;
     int palette_size;
+    int palette_version;  // changed by the caller whenever it rewrites palette in place
     Uint32* buffer;
-    ATOMIC_BOOL* kill_signal;
+    ATOMIC_INT* generation_signal;  // newest frame posted, job stops when it no longer matches generation
+    int generation;
     int start_render_frac;
+    int end_render_frac;     // last fraction rendered before returning, 1 renders to full resolution
+    int coarse_render_frac;  // first pass of the frame, later passes only compute the samples new on their grid
+    bool solid_guess;        // refinement passes skip samples whose coarse neighbours all agree
+    int* iterations;         // count per screen pixel, shared by every tile of the frame
+    struct Reprojection* reproject;  // NULL unless the frame starts from a zoomed copy of the last one
+    bool recolour;                   // only palette or shading changed, the last frame's counts can be recoloured
+    struct OrbitStore* orbits;       // NULL unless the pool saves orbits at the limit
+    int resume_limit;                // the last frame's limit in a RESUME_PASS
     bool render_smooth;
     bool use_simd;
     int* iteration_out;
+    Uint32* colour_out;  // per-row scratch for colours replicated over coarse pass blocks
+    struct OrbitState* orbit_out;  // per-row scratch for orbits saved or resumed
     bool no_optimisations;
-};
 
-struct ThreadPool {
-    pthread_t* threads;
-    struct RenderJob* jobs;
-    long count;
-    ATOMIC_BOOL kill;
+    // deep zoom, see perturbation.h
+    enum Precision precision;      // set by the caller, for perturbation the pool provides perturb and the scratch below
+    struct Perturbation* perturb;  // reference orbit for this frame, NULL renders with plain doubles
+    bool fix_glitches;             // re-render only the pixels flagged in perturb->glitched
+    double* delta_out;             // per-row pixel offsets from the reference
+    unsigned char* glitch_out;
+    int glitched_pixels;  // pixels still glitched after the full resolution pass or fix
+    long long iterations_skipped;  // jumped over by bilinear approximation steps
+
+    struct IterationCounts counts;  // lane efficiency = iterations / lane_steps
+
+    // full resolution pass by Mariani-Silver subdivision instead of computing every pixel
+    bool mariani_silver;
+    long long pixels_computed;  // samples actually iterated, all passes
+
+    // adaptive anti-aliasing, see AA_PASS
+    int aa_samples;           // extra samples per edge pixel at most, 0 turns it off
+    int aa_budget;            // extra samples per frame at most, 0 allows one per screen pixel
+    double aa_share;          // set by the pool for AA_PASS: samples per edge pixel the budget allows
+    ATOMIC_INT* aa_reserved;  // samples the frame's tiles have taken from the budget
+    long long aa_edges;       // edge pixels found in the tile
+    long long aa_used;        // extra samples it took
+    unsigned int* aa_sum;     // per-row scratch: red, green, blue and weight of each pixel's samples
+    unsigned char* aa_want;   // per-row scratch: samples each pixel takes
+
+    // temporal accumulation, see ACCUMULATE_PASS
+    int accum_sample;     // 0 renders normally, sample k >= 1 adds the k-th and the first starts the average
+    unsigned int* accum;  // red, green, blue and weight summed per screen pixel
 };
 
+// default limit for a zoom, before the viewer's iteration multiplier
+int calculateIterations(double zoom);
+
 int calculateMandelbrot(double x0, double y0, int iterations);
 int calculateMandelbrotOpts(double x0, double y0, int iterations, bool no_optimisations);
+int continueMandelbrot(double x0, double y0, int iterations, bool no_optimisations, struct OrbitState* orbit,
+                       struct IterationCounts* counts);
 void* calculateMandelbrotRoutine(void* arg);
 
+// cheapest precision that resolves every pixel of the viewport
+enum Precision select_precision(const struct viewport* vp);
+const char* precision_name(enum Precision precision);
+
 #ifdef __cplusplus
 }
 #endif
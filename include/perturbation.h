@@ -0,0 +1,86 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include "mandelbrot.h"
+
+#include <stdbool.h>
+
+// below this pixel size (relative to the centre's magnitude) double-double lanes run out of bits
+// and select_precision() hands the frame to a reference orbit
+#define PERTURBATION_ZOOM 1e-28
+
+// Pauldelbrot's glitch criterion |Z + dz| < 1e-3 * |Z|, squared
+#define GLITCH_TOLERANCE 1e-6
+
+// reference orbits per frame before any remaining glitches are left as they are
+#define MAX_REFERENCES 16
+
+// relative error allowed for the dropped dz^2 term of a bilinear step, about one double ulp
+#define BLA_EPSILON 0x1p-53
+#define BLA_MAX_LEVELS 28
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct viewport;
+
+// bilinear approximation of `steps` iterations: dz' = A dz + B dc, valid while |dz|^2 < r2
+struct BLAStep {
+    double ar, ai;
+    double br, bi;
+    double r2;
+    int steps;
+};
+
+// one reference point iterated at full precision, rounded to doubles for the delta kernels
+struct ReferenceOrbit {
+    double* zr;
+    double* zi;
+    double* glitch_bound;  // GLITCH_TOLERANCE * |Z_n|^2
+    int length;            // valid entries, shorter than the iteration limit when the reference escapes
+    int capacity;
+    int ref_x, ref_y;  // reference position in screen pixels
+
+    // level k holds steps of 2^k iterations starting at iteration 1 + j * 2^k
+    struct BLAStep* bla;
+    int bla_offset[BLA_MAX_LEVELS];
+    int bla_count[BLA_MAX_LEVELS];
+    int bla_levels;  // 0 disables skipping
+    int bla_capacity;
+};
+
+struct Perturbation {
+    struct ReferenceOrbit orbit;
+    unsigned char* glitched;  // per pixel, written by the full resolution pass and cleared as glitches are fixed
+    int width, height;
+    int references;  // orbits computed for the current frame
+};
+
+int perturbation_init(struct Perturbation* p, int width, int height);
+void perturbation_free(struct Perturbation* p);
+
+// compute the frame's reference orbit: the screen centre first, then (rereference) a point inside the
+// remaining glitched pixels. returns false if cancelled, out of memory, or there is nothing left to fix
+bool perturbation_prepare(struct Perturbation* p, const struct RenderJob* frame, bool rereference);
+
+// iterate pixels at c = reference + (dcx[i], dcy); glitched[i] is set where the reference can't be trusted
+// iterations jumped over by bilinear steps are added to data->iterations_skipped, the ones taken to data->counts
+void perturbation_row(struct RenderJob* data, const double* dcx, double dcy, int pixel_count, int* out_iterations,
+                      unsigned char* glitched);
+
+// same for a column of pixels at c = reference + (dcx, dcy[i])
+void perturbation_column(struct RenderJob* data, double dcx, const double* dcy, int pixel_count, int* out_iterations,
+                         unsigned char* glitched);
+
+int perturbation_pixel(const struct ReferenceOrbit* ref, double dcx, double dcy, int max_iterations, unsigned char* glitched,
+                       long long* skipped, struct IterationCounts* counts);
+
+// longest bilinear step starting at iteration m that is valid for |dz|^2 = dz2 and ends by limit, NULL if none
+const struct BLAStep* perturbation_bla_lookup(const struct ReferenceOrbit* ref, int m, double dz2, int limit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,6 +10,12 @@ struct RenderContext {
     Uint32* buffer;
     int width;
     int height;
+    bool mariani_silver;  // full resolution pass by subdivision, see marianiSilverTile()
+    bool solid_guess;     // refinement passes fill samples whose coarse neighbours agree, see guessSample()
+    int aa_samples;       // extra samples per edge pixel once a frame is at full resolution, see AA_PASS
+    unsigned int* accum;  // running sums of the samples taken while the view is idle, see ACCUMULATE_PASS
+    int accum_samples;    // taken since the view last changed
+    bool texture_current;  // the texture holds what the idle pool left in buffer
 };
 
 #endif
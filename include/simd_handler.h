@@ -2,12 +2,18 @@
 #define SIMD_HANDLER
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// compute one row of Mandelbrot iteration counts using SIMD
+struct OrbitState;
+struct IterationCounts;
+
+// compute one row of Mandelbrot iteration counts using SIMD, adding the work done to counts
+// orbit_in (may be NULL) continues each pixel from a saved orbit; orbit_out (may be NULL, or orbit_in)
+// receives the orbit of each pixel that ends at max_iterations, see struct OrbitState
 
 void mandelbrot_simd_row(
     double x0_start,
@@ -16,10 +22,164 @@ void mandelbrot_simd_row(
     int max_iterations,
     int* out_iterations,
     int pixel_count,
-    bool no_optimisations);
+    bool no_optimisations,
+    const struct OrbitState* orbit_in,
+    struct OrbitState* orbit_out,
+    struct IterationCounts* counts);
+
+// same in float32 lanes, only accurate at shallow zoom (see select_precision); the orbits it saves hold float
+// values and are only continued by it
+void mandelbrot_simd_row_f32(
+    double x0_start,
+    double y0,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    const struct OrbitState* orbit_in,
+    struct OrbitState* orbit_out,
+    struct IterationCounts* counts);
+
+// double-double lanes for zooms between plain doubles and perturbation
+// pixel px is at c = (cx_hi + cx_lo) + x_offset + px * zoom_step, cy = (cy_hi + cy_lo) + y_offset
+void mandelbrot_simd_row_dd(
+    double cx_hi,
+    double cx_lo,
+    double x_offset,
+    double cy_hi,
+    double cy_lo,
+    double y_offset,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    struct IterationCounts* counts);
+
+struct ReferenceOrbit;
+
+// perturbation deltas for one row against a reference orbit (see perturbation.h)
+void mandelbrot_simd_perturb_row(
+    const struct ReferenceOrbit* ref,
+    const double* dcx,
+    double dcy,
+    int max_iterations,
+    int* out_iterations,
+    unsigned char* glitched,
+    int pixel_count,
+    long long* skipped,
+    struct IterationCounts* counts);
+
+// the same kernels down a column of pixel_count pixels: pixel px is at (x0, y_origin + (y_first + px) * zoom_step),
+// which gives every pixel the cy its own row's span computes with. the double-double one is centred as
+// mandelbrot_simd_row_dd() is, at x_offset and y offset (y_first + px) * zoom_step; perturbation deltas are (dcx, dcy[px])
+
+void mandelbrot_simd_column(
+    double x0,
+    double y_origin,
+    int y_first,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    const struct OrbitState* orbit_in,
+    struct OrbitState* orbit_out,
+    struct IterationCounts* counts);
+
+void mandelbrot_simd_column_f32(
+    double x0,
+    double y_origin,
+    int y_first,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    const struct OrbitState* orbit_in,
+    struct OrbitState* orbit_out,
+    struct IterationCounts* counts);
+
+void mandelbrot_simd_column_dd(
+    double cx_hi,
+    double cx_lo,
+    double x_offset,
+    double cy_hi,
+    double cy_lo,
+    int y_first,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    struct IterationCounts* counts);
+
+void mandelbrot_simd_perturb_column(
+    const struct ReferenceOrbit* ref,
+    double dcx,
+    const double* dcy,
+    int max_iterations,
+    int* out_iterations,
+    unsigned char* glitched,
+    int pixel_count,
+    long long* skipped,
+    struct IterationCounts* counts);
+
+// source pixels closer than this to a destination pixel's point are the same sample
+#define REPROJECT_TOLERANCE 1e-3
+
+// resample one row of the last frame's counts for a zoomed frame: pixel px takes the source pixel
+// nearest src_x0 + px * scale, clamped to max_iterations, or -1 where that is off the row or unknown (< 0)
+// exact[px] is set when the source lies on the pixel's own point (row_exact says the row does) and its
+// count, being below exact_limit, is what iterating the pixel would give
+void mandelbrot_simd_reproject_row(
+    const int* src_row,
+    int src_width,
+    double src_x0,
+    double scale,
+    bool row_exact,
+    int max_iterations,
+    int exact_limit,
+    int* out_iterations,
+    unsigned char* exact,
+    int pixel_count);
+
+// palette colours for count iteration counts, mapped as iterationColour() in mandelbrot.c does
+// palette_scale is the integer palette_size / max_iterations used by the cyclic (smooth) mode
+void mandelbrot_simd_colour_row(
+    const int* iterations,
+    int count,
+    int max_iterations,
+    const uint32_t* palette,
+    int palette_size,
+    bool smooth,
+    int palette_scale,
+    uint32_t* out);
+
+// paint span pixels of a row with one colour per sample, for passes below full resolution:
+// pixel j takes colours[j >> step_shift] where (j & ((1 << step_shift) - 1)) < frac, skipping
+// pixels whose kind (when not NULL) isn't REPROJECT_NONE
+void mandelbrot_simd_paint_row(
+    const uint32_t* colours,
+    int step_shift,
+    int frac,
+    const unsigned char* kind,
+    int span,
+    uint32_t* dst);
 
 void mandelbrot_simd_print_targets(void);
 
+// name of the target dynamic dispatch runs the kernels on, the best this CPU supports unless one was forced
+const char* mandelbrot_simd_target(void);
+
+// names of the compiled targets this CPU can run, best first; fills at most max of them and returns how many there are
+int mandelbrot_simd_targets(const char** names, int max);
+
+// run every kernel on the named target (as mandelbrot_simd_targets() names it) instead of the best one, NULL goes
+// back to the best; returns false when it isn't compiled in or this CPU can't run it. not safe while kernels run
+bool mandelbrot_simd_set_target(const char* name);
+
 #ifdef __cplusplus
 }
 #endif
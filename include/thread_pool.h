@@ -0,0 +1,168 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include "inputHandler.h"  // for struct viewport
+#include "mandelbrot.h"
+#include "perturbation.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEFAULT_TILE_SIZE 64
+
+struct ThreadPool;
+
+struct RenderTile {
+    int start_x, end_x;
+    int start_y, end_y;
+};
+
+// per-worker queue of tile indices; the owner pops from the tail, idle workers steal from the head
+struct TileDeque {
+    pthread_mutex_t lock;
+    int* tiles;
+    int head, tail;
+    int frac;  // render fraction of the pass the queued tiles belong to
+};
+
+struct PoolWorker {
+    struct ThreadPool* pool;
+    int index;
+    struct TileDeque queue;
+    double busy_ms;  // time spent rendering tiles in the running generation
+};
+
+// long-lived render workers; each posted frame is a new "generation"
+// posting a frame cancels the previous one without blocking the caller
+//
+// a frame is cut into tiles and rendered one progressive pass (8 -> 4 -> 2 -> 1) at a time,
+// so the whole screen gets a coarse preview before any tile is refined
+//
+// a frame posted with recolour set that doesn't change the view of the previous, finished one only
+// recolours its iteration counts (see RECOLOUR_PASS)
+//
+// a frame that only raises the iteration limit of the previous, finished one iterates just the pixels that
+// reached the old limit, carrying on from the orbits saved for them (see RESUME_PASS)
+//
+// a frame that zooms the previous, finished one first fills the screen with a resampled copy of it,
+// then its passes only compute pixels that copy didn't already hold exactly
+//
+// a frame that only moves the previous one by whole pixels shifts its pixels and queues just the strips the pan
+// exposed, so dragging costs in proportion to the strip rather than the screen. the previous frame needn't have
+// finished: what it left undone is queued along with the strips (see final_pixels)
+//
+// a frame asking for anti-aliasing finishes by finding the pixels whose count differs sharply from a neighbour's
+// and averaging jittered subsamples into them, within its sample budget (see AA_PASS)
+//
+// deep frames first compute a reference orbit (one worker, the rest wait), and after the full
+// resolution pass re-reference inside any glitched pixels and re-render just those, up to MAX_REFERENCES
+struct ThreadPool {
+    pthread_t* threads;
+    struct PoolWorker* workers;
+    struct RenderJob* jobs;  // per-worker job, holds scratch buffers
+    long count;
+    long started;  // threads successfully created
+
+    // tile_size 0 keeps one static band per thread (no stealing possible)
+    int tile_size;
+    struct RenderTile* tiles;
+    int tile_count;
+    int* iterations;  // count per screen pixel; each pass refines the previous one's samples in place
+
+    // a zoom starts with the last finished frame resampled from previous_iterations (see REPROJECT_PASS)
+    int* previous_iterations;
+    struct Reprojection reprojection;
+
+    // orbits of the pixels the finished frame left at its limit, for a RESUME_PASS
+    struct OrbitStore orbits;
+
+    // tiles queued for the running frame: the screen's, or chunks of the strips a pan exposed or of the rows
+    // left after mirroring
+    struct RenderTile* frame_tiles;
+    int frame_tile_count;
+    struct RenderTile* pan_tiles;
+    int pan_tile_count;
+    unsigned char* final_pixels;  // per pixel, set once the running or last frame has its final count and colour
+
+    // a view across the real axis computes row y for row mirror_axis - y too, whose counts are the same
+    // by conjugate symmetry; rows mirror_start up to mirror_end are copied rather than queued
+    int mirror_axis;
+    int mirror_start, mirror_end;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;  // a generation or pass was posted, or the pool went idle
+    pthread_cond_t work_done;   // the running generation finished
+
+    ATOMIC_INT generation;   // newest posted frame, workers abandon anything older
+    int running_generation;  // frame currently being rendered
+    int active;              // workers inside running_generation
+    int pass_frac;           // render fraction of the current pass
+    int tiles_completed;     // tiles finished in the current pass
+    int phase;               // bumped whenever new work is queued or the frame's state changes
+    bool frame_done;
+    bool counts_final;  // the last full frame finished, even if an accumulation frame after it was cut short
+    bool forget_frame;  // thread_pool_reset_reuse() was called, the next frame reuses nothing of the last
+    bool shutdown;
+
+    // frame posted by thread_pool_render(), copied to frame once the pool is idle
+    struct RenderJob pending;
+    struct viewport pending_vp;
+
+    // read-only to workers while active > 0
+    struct RenderJob frame;
+    struct viewport frame_vp;
+
+    struct Perturbation perturb;
+    bool needs_reference;  // the frame can't continue until a reference orbit is computed
+    bool preparing;        // a worker is computing it
+    bool have_reference;   // the frame already has one, the next is a re-reference
+    int glitched_pixels;   // left by the last full resolution or glitch pass
+    long long iterations_skipped;  // by bilinear approximation, whole frame
+    struct IterationCounts counts;  // whole frame, summed from each tile's own
+    long long pixels_computed;  // samples iterated, whole frame
+
+    // adaptive anti-aliasing of the frame's edges, see AA_PASS
+    ATOMIC_INT aa_reserved;
+    long long aa_edges;
+    long long aa_used;
+};
+
+// returns 0 on success
+int thread_pool_init(struct ThreadPool* tp, long count, int scrn_width, int scrn_height, int tile_size);
+
+// post a new frame, cancelling any frame still in progress
+void thread_pool_render(struct ThreadPool* tp, const struct RenderJob* frame);
+
+// the next frame posted renders from scratch, reusing nothing of the last one (recolour, pan, zoom or resume)
+void thread_pool_reset_reuse(struct ThreadPool* tp);
+
+// block until the most recently posted frame has finished
+void thread_pool_wait(struct ThreadPool* tp);
+
+// whether the most recently posted frame has finished, without waiting
+bool thread_pool_finished(struct ThreadPool* tp);
+
+// busy time of the slowest worker and the mean across workers for the last finished frame
+void thread_pool_load_balance(struct ThreadPool* tp, double* max_ms, double* mean_ms);
+
+// reference orbits used, pixels left glitched and iterations skipped by approximation in the last finished frame
+void thread_pool_perturbation_stats(struct ThreadPool* tp, int* references, int* glitched_pixels, long long* iterations_skipped);
+
+// samples iterated in the last finished frame over its pixel count; every pixel is sampled by one pass, so this
+// is 1 unless solid guessing or Mariani-Silver filled some in, rows were mirrored (or glitches were re-rendered)
+double thread_pool_computed_fraction(struct ThreadPool* tp);
+
+// iterations the kernels took in the last finished frame, the lane steps they took them in and the pixels
+// answered early, see struct IterationCounts
+void thread_pool_iteration_counts(struct ThreadPool* tp, struct IterationCounts* counts);
+
+// orbits saved by the last finished frame, those the store had no room for, and the store's fixed size in bytes
+void thread_pool_orbit_stats(struct ThreadPool* tp, int* saved, int* dropped, size_t* bytes);
+
+// edge pixels the last finished frame anti-aliased and the extra samples it took for them, 0 with it off
+void thread_pool_aa_stats(struct ThreadPool* tp, long long* edges, long long* samples);
+
+void thread_pool_destroy(struct ThreadPool* tp);
+
+#endif
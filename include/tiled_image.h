@@ -0,0 +1,73 @@
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <SDL3/SDL_stdinc.h>  // for Uint32
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// an image too large for memory, kept as square tiles in a memory-mapped file so the pool can draw each
+// tile straight into the mapping, and an interrupted render can pick up from the tiles it finished
+//
+// file layout, every field in the machine's byte order:
+//   0                    struct TiledHeader
+//   TILED_HEADER_BYTES   one byte per tile, 1 once the tile is complete on disk
+//   data_offset          the tiles in row-major order, tile (tx, ty) at index ty * tiles_x + tx, each
+//                        tile_size * tile_size 0xAARRGGBB pixels in rows tile_size apart. tiles on the right
+//                        and bottom edges are stored whole, their pixels past the image are rendered but unused
+#define TILED_MAGIC "MBTILES1"
+#define TILED_HEADER_BYTES 64
+
+// tiles and the data offset are aligned to this, so each tile is whole pages of the mapping
+#define TILED_ALIGN 65536
+#define TILED_TILE_MULTIPLE 64  // 64 * 64 pixels is 16 KiB, the largest common page
+
+struct TiledHeader {
+    char magic[8];
+    uint32_t width, height;
+    uint32_t tile_size;
+    uint32_t tiles_x, tiles_y;
+    uint32_t reserved;
+    uint64_t key;          // hash of the render settings, a resumed render must match it
+    uint64_t data_offset;  // bytes from the start of the file to tile 0
+};
+
+struct TiledImage {
+    struct TiledHeader header;
+    unsigned char* base;  // the whole file
+    size_t size;
+    unsigned char* done;  // per tile
+    int tile_count;
+    int tiles_done;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+// maps path, creating it when it doesn't exist; an existing file must have been started with the same size,
+// tile size and key. tile_size is rounded up to TILED_TILE_MULTIPLE. returns NULL, after reporting why, on failure
+struct TiledImage* tiled_open(const char* path, int width, int height, int tile_size, uint64_t key);
+
+// maps an existing file whatever it holds, for reading it back
+struct TiledImage* tiled_open_existing(const char* path);
+
+// first pixel of a tile in the mapping
+Uint32* tiled_tile(struct TiledImage* image, int tile);
+
+// flushes a drawn tile to disk, then marks it complete. returns 0 on success
+int tiled_finish_tile(struct TiledImage* image, int tile);
+
+// unmaps and closes, returns 0 on success
+int tiled_close(struct TiledImage* image);
+
+// writes a complete tiled image out as PNG or PPM (see image_writer.h) a row at a time, returns 0 on success
+int tiled_export(const char* path, const char* output);
+
+#endif
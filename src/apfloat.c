@@ -0,0 +1,167 @@
+#include "apfloat.h"
+
+#include <math.h>
+#include <string.h>
+
+#define INT_LIMB (APFLOAT_LIMBS - 1)
+
+static bool is_zero(const struct apfloat* a) {
+    for (int i = 0; i < APFLOAT_LIMBS; i++) {
+        if (a->limb[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+// compare magnitudes, ignoring sign
+static int compare_mag(const struct apfloat* a, const struct apfloat* b) {
+    for (int i = APFLOAT_LIMBS - 1; i >= 0; i--) {
+        if (a->limb[i] != b->limb[i])
+            return a->limb[i] > b->limb[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+static void add_mag(uint32_t* out, const uint32_t* a, const uint32_t* b) {
+    uint64_t carry = 0;
+    for (int i = 0; i < APFLOAT_LIMBS; i++) {
+        uint64_t sum = (uint64_t)a[i] + b[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+// requires |a| >= |b|
+static void sub_mag(uint32_t* out, const uint32_t* a, const uint32_t* b) {
+    int64_t borrow = 0;
+    for (int i = 0; i < APFLOAT_LIMBS; i++) {
+        int64_t diff = (int64_t)a[i] - b[i] - borrow;
+        borrow = diff < 0;
+        out[i] = (uint32_t)(diff + (borrow << 32));
+    }
+}
+
+void ap_from_double(struct apfloat* out, double x) {
+    memset(out, 0, sizeof(*out));
+    out->negative = x < 0.0;
+
+    double mag = fabs(x);
+    double whole = floor(mag);
+    out->limb[INT_LIMB] = (uint32_t)whole;
+
+    // peel off 32 bits at a time; exact because a double holds at most 53 significant bits
+    double frac = mag - whole;
+    for (int i = INT_LIMB - 1; i >= 0 && frac != 0.0; i--) {
+        frac *= 4294967296.0;
+        double bits = floor(frac);
+        out->limb[i] = (uint32_t)bits;
+        frac -= bits;
+    }
+}
+
+double ap_to_double(const struct apfloat* a) {
+    double x = 0.0;
+    for (int i = 0; i < APFLOAT_LIMBS; i++) {
+        x = x / 4294967296.0 + (double)a->limb[i];
+    }
+    return a->negative ? -x : x;
+}
+
+bool ap_from_string(struct apfloat* out, const char* str) {
+    memset(out, 0, sizeof(*out));
+
+    bool negative = false;
+    if (*str == '-' || *str == '+') {
+        negative = *str == '-';
+        str++;
+    }
+
+    uint64_t whole = 0;
+    const char* p = str;
+    while (*p >= '0' && *p <= '9') {
+        whole = whole * 10 + (uint64_t)(*p - '0');
+        if (whole > UINT32_MAX)
+            return false;
+        p++;
+    }
+
+    const char* frac_start = NULL;
+    const char* frac_end = NULL;
+    if (*p == '.') {
+        frac_start = ++p;
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        frac_end = p;
+    }
+    if (*p != '\0' || p == str) {
+        return false;
+    }
+
+    // horner from the last digit: f = (digit + f) / 10, long division limb by limb
+    if (frac_start != NULL) {
+        for (const char* d = frac_end - 1; d >= frac_start; d--) {
+            out->limb[INT_LIMB] = (uint32_t)(*d - '0');
+            uint64_t rem = 0;
+            for (int i = INT_LIMB; i >= 0; i--) {
+                uint64_t cur = (rem << 32) | out->limb[i];
+                out->limb[i] = (uint32_t)(cur / 10);
+                rem = cur % 10;
+            }
+        }
+    }
+
+    out->limb[INT_LIMB] = (uint32_t)whole;
+    out->negative = negative && !is_zero(out);
+    return true;
+}
+
+void ap_add(struct apfloat* out, const struct apfloat* a, const struct apfloat* b) {
+    struct apfloat r;
+    if (a->negative == b->negative) {
+        add_mag(r.limb, a->limb, b->limb);
+        r.negative = a->negative;
+    } else if (compare_mag(a, b) >= 0) {
+        sub_mag(r.limb, a->limb, b->limb);
+        r.negative = a->negative;
+    } else {
+        sub_mag(r.limb, b->limb, a->limb);
+        r.negative = b->negative;
+    }
+    if (is_zero(&r))
+        r.negative = false;
+    *out = r;
+}
+
+void ap_sub(struct apfloat* out, const struct apfloat* a, const struct apfloat* b) {
+    struct apfloat neg_b = *b;
+    neg_b.negative = !b->negative;
+    ap_add(out, a, &neg_b);
+}
+
+void ap_mul(struct apfloat* out, const struct apfloat* a, const struct apfloat* b) {
+    // schoolbook product of the raw limbs, then drop the extra fraction limbs
+    uint32_t product[2 * APFLOAT_LIMBS] = {0};
+    for (int i = 0; i < APFLOAT_LIMBS; i++) {
+        uint64_t carry = 0;
+        if (a->limb[i] == 0)
+            continue;
+        for (int j = 0; j < APFLOAT_LIMBS; j++) {
+            uint64_t t = (uint64_t)a->limb[i] * b->limb[j] + product[i + j] + carry;
+            product[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        product[i + APFLOAT_LIMBS] = (uint32_t)carry;
+    }
+
+    struct apfloat r;
+    memcpy(r.limb, product + INT_LIMB, sizeof(r.limb));  // integer overflow beyond 32 bits is dropped
+    r.negative = (a->negative != b->negative) && !is_zero(&r);
+    *out = r;
+}
+
+void ap_add_double(struct apfloat* out, const struct apfloat* a, double x) {
+    struct apfloat b;
+    ap_from_double(&b, x);
+    ap_add(out, a, &b);
+}
@@ -0,0 +1,382 @@
+#include "bench_report.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// generated by CMake on every build, see cmake/git_revision.cmake
+#ifdef HAVE_GIT_REVISION_H
+#include "git_revision.h"
+#endif
+#ifndef GIT_REVISION
+#define GIT_REVISION "unknown"
+#endif
+
+static int compare_ms(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void bench_stats(const double* runs_ms, int count, struct BenchStats* out) {
+    memset(out, 0, sizeof(*out));
+    out->runs = count;
+    if (count <= 0) {
+        return;
+    }
+
+    double* sorted = malloc((size_t)count * sizeof(double));
+    if (!sorted) {
+        return;
+    }
+    memcpy(sorted, runs_ms, (size_t)count * sizeof(double));
+    qsort(sorted, (size_t)count, sizeof(double), compare_ms);
+
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) {
+        sum += sorted[i];
+    }
+    out->mean = sum / count;
+    double squares = 0.0;
+    for (int i = 0; i < count; i++) {
+        squares += (sorted[i] - out->mean) * (sorted[i] - out->mean);
+    }
+    out->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0.0;
+
+    out->min = sorted[0];
+    out->median = count % 2 ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+    int rank = (int)ceil(0.95 * count);
+    out->p95 = sorted[rank > 0 ? rank - 1 : 0];
+    free(sorted);
+}
+
+const char* bench_revision(void) {
+    return GIT_REVISION[0] ? GIT_REVISION : "unknown";
+}
+
+static bool ends_with_csv(const char* path) {
+    size_t len = strlen(path);
+    if (len < 4) {
+        return false;
+    }
+    const char* ext = path + len - 4;
+    return ext[0] == '.' && (ext[1] | 0x20) == 'c' && (ext[2] | 0x20) == 's' && (ext[3] | 0x20) == 'v';
+}
+
+// quoted, with the characters JSON and CSV can't hold bare escaped
+static void put_string(FILE* f, const char* s, bool json) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"') {
+            fputs(json ? "\\\"" : "\"\"", f);
+        } else if (*s == '\\' && json) {
+            fputs("\\\\", f);
+        } else if ((unsigned char)*s >= 0x20) {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// billions of iterations a second at the median time
+static double rate(const struct BenchSceneResult* scene) {
+    return scene->stats.median > 0.0 ? (double)scene->iterations / (scene->stats.median / 1000.0) / 1e9 : 0.0;
+}
+
+static double lane_efficiency(const struct BenchSceneResult* scene) {
+    return scene->lane_steps > 0 ? (double)scene->iterations / (double)scene->lane_steps : 0.0;
+}
+
+static void write_csv(FILE* f, const struct BenchReport* r) {
+    fprintf(f, "scene,precision,threads,simd_target,forced_precision,mode,scene_set,width,height,revision,warmup,repeats,"
+               "min_ms,median_ms,p95_ms,mean_ms,stddev_ms,giter_per_s,lane_efficiency,iterations,inside_pixels,periodic_pixels\n");
+    for (int i = 0; i < r->scene_count; i++) {
+        const struct BenchSceneResult* s = &r->scenes[i];
+        put_string(f, s->name, false);
+        fprintf(f, ",%s,%ld,%s,%s,%s,%s,%d,%d,", s->precision, r->threads, r->simd_target, r->precision, r->mode, r->scene_set, r->width,
+                r->height);
+        put_string(f, bench_revision(), false);
+        fprintf(f, ",%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%.4f,%lld,%lld,%lld\n", r->warmup, s->stats.runs, s->stats.min, s->stats.median,
+                s->stats.p95, s->stats.mean, s->stats.stddev, rate(s), lane_efficiency(s), s->iterations, s->inside, s->periodic);
+    }
+}
+
+static void write_json(FILE* f, const struct BenchReport* r) {
+    fprintf(f, "{\n  \"revision\": ");
+    put_string(f, bench_revision(), true);
+    fprintf(f, ",\n  \"threads\": %ld,\n  \"simd_target\": \"%s\",\n  \"precision\": \"%s\",\n  \"mode\": \"%s\",\n", r->threads,
+            r->simd_target, r->precision, r->mode);
+    fprintf(f, "  \"scene_set\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"warmup\": %d,\n  \"repeats\": %d,\n  \"scenes\": [",
+            r->scene_set, r->width, r->height, r->warmup, r->repeats);
+    for (int i = 0; i < r->scene_count; i++) {
+        const struct BenchSceneResult* s = &r->scenes[i];
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        put_string(f, s->name, true);
+        fprintf(f, ", \"precision\": \"%s\", \"runs_ms\": [", s->precision);
+        for (int k = 0; k < s->stats.runs; k++) {
+            fprintf(f, "%s%.3f", k ? ", " : "", s->runs_ms[k]);
+        }
+        fprintf(f, "],\n     \"min_ms\": %.3f, \"median_ms\": %.3f, \"p95_ms\": %.3f, \"mean_ms\": %.3f, \"stddev_ms\": %.3f,\n",
+                s->stats.min, s->stats.median, s->stats.p95, s->stats.mean, s->stats.stddev);
+        fprintf(f, "     \"giter_per_s\": %.4f, \"lane_efficiency\": %.4f, \"iterations\": %lld, \"inside_pixels\": %lld, "
+                   "\"periodic_pixels\": %lld}",
+                rate(s), lane_efficiency(s), s->iterations, s->inside, s->periodic);
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+int bench_write_report(const char* path, const struct BenchReport* report) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "benchmark: can't create %s\n", path);
+        return 1;
+    }
+    if (ends_with_csv(path)) {
+        write_csv(f, report);
+    } else {
+        write_json(f, report);
+    }
+    int status = ferror(f) ? 1 : 0;
+    if (fclose(f) != 0) {
+        status = 1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "benchmark: writing %s failed\n", path);
+    }
+    return status;
+}
+
+// baseline file, one setting or scene per line:
+//   mandelbrot-baseline 1
+//   <key> <value>          for revision, threads, simd_target, precision, mode, scene_set and size (W H)
+//   scene <runs> <ms>... <name>
+#define BASELINE_MAGIC "mandelbrot-baseline 1"
+#define BASELINE_NAME 128
+
+struct BaselineScene {
+    char name[BASELINE_NAME];
+    int runs;
+    double* ms;
+};
+
+struct Baseline {
+    char revision[BASELINE_NAME];
+    long threads;
+    char simd_target[BASELINE_NAME];
+    char precision[BASELINE_NAME];
+    char mode[BASELINE_NAME];
+    char scene_set[BASELINE_NAME];
+    int width, height;
+    struct BaselineScene* scenes;
+    int scene_count;
+};
+
+int bench_save_baseline(const char* path, const struct BenchReport* r) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "benchmark: can't create %s\n", path);
+        return 1;
+    }
+    fprintf(f, "%s\nrevision %s\nthreads %ld\nsimd_target %s\nprecision %s\nmode %s\nscene_set %s\nsize %d %d\n", BASELINE_MAGIC,
+            bench_revision(), r->threads, r->simd_target, r->precision, r->mode, r->scene_set, r->width, r->height);
+    for (int i = 0; i < r->scene_count; i++) {
+        const struct BenchSceneResult* s = &r->scenes[i];
+        fprintf(f, "scene %d", s->stats.runs);
+        for (int k = 0; k < s->stats.runs; k++) {
+            fprintf(f, " %.6f", s->runs_ms[k]);
+        }
+        fprintf(f, " %s\n", s->name);
+    }
+    int status = ferror(f) ? 1 : 0;
+    if (fclose(f) != 0) {
+        status = 1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "benchmark: writing %s failed\n", path);
+    }
+    return status;
+}
+
+static void free_baseline(struct Baseline* b) {
+    for (int i = 0; i < b->scene_count; i++) {
+        free(b->scenes[i].ms);
+    }
+    free(b->scenes);
+}
+
+static bool read_scene(FILE* f, struct BaselineScene* scene) {
+    if (fscanf(f, "%d", &scene->runs) != 1 || scene->runs <= 0 || scene->runs > 1000000) {
+        return false;
+    }
+    scene->ms = malloc((size_t)scene->runs * sizeof(double));
+    if (!scene->ms) {
+        return false;
+    }
+    for (int k = 0; k < scene->runs; k++) {
+        if (fscanf(f, "%lf", &scene->ms[k]) != 1) {
+            return false;
+        }
+    }
+    // the name is the rest of the line
+    if (fscanf(f, " %127[^\n]", scene->name) != 1) {
+        return false;
+    }
+    return true;
+}
+
+static bool read_baseline(const char* path, struct Baseline* b) {
+    memset(b, 0, sizeof(*b));
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "benchmark: can't open baseline %s\n", path);
+        return false;
+    }
+
+    char line[64];
+    bool ok = fgets(line, sizeof(line), f) && strncmp(line, BASELINE_MAGIC, strlen(BASELINE_MAGIC)) == 0;
+    char key[32];
+    while (ok && fscanf(f, "%31s", key) == 1) {
+        if (strcmp(key, "scene") == 0) {
+            struct BaselineScene* grown = realloc(b->scenes, (size_t)(b->scene_count + 1) * sizeof(struct BaselineScene));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            b->scenes = grown;
+            struct BaselineScene* scene = &b->scenes[b->scene_count++];
+            memset(scene, 0, sizeof(*scene));
+            ok = read_scene(f, scene);
+        } else if (strcmp(key, "revision") == 0) {
+            ok = fscanf(f, "%127s", b->revision) == 1;
+        } else if (strcmp(key, "threads") == 0) {
+            ok = fscanf(f, "%ld", &b->threads) == 1;
+        } else if (strcmp(key, "simd_target") == 0) {
+            ok = fscanf(f, "%127s", b->simd_target) == 1;
+        } else if (strcmp(key, "precision") == 0) {
+            ok = fscanf(f, "%127s", b->precision) == 1;
+        } else if (strcmp(key, "mode") == 0) {
+            ok = fscanf(f, "%127s", b->mode) == 1;
+        } else if (strcmp(key, "scene_set") == 0) {
+            ok = fscanf(f, "%127s", b->scene_set) == 1;
+        } else if (strcmp(key, "size") == 0) {
+            ok = fscanf(f, "%d %d", &b->width, &b->height) == 2;
+        } else {
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if (!ok || b->scene_count == 0) {
+        fprintf(stderr, "benchmark: %s isn't a benchmark baseline\n", path);
+        free_baseline(b);
+        return false;
+    }
+    return true;
+}
+
+// chance that now's runs rank this far above base's if both came from the same distribution: the one-sided
+// Mann-Whitney U test in its normal approximation, with continuity and tie corrections
+static double slower_p_value(const double* base, int n1, const double* now, int n2) {
+    double u = 0.0;
+    for (int i = 0; i < n1; i++) {
+        for (int j = 0; j < n2; j++) {
+            u += now[j] > base[i] ? 1.0 : now[j] == base[i] ? 0.5 : 0.0;
+        }
+    }
+
+    // ties shrink the variance by the sum of t^3 - t over each group of t equal times
+    int n = n1 + n2;
+    double ties = 0.0;
+    for (int i = 0; i < n; i++) {
+        double x = i < n1 ? base[i] : now[i - n1];
+        int equal = 0;
+        bool first = true;
+        for (int k = 0; k < n; k++) {
+            double y = k < n1 ? base[k] : now[k - n1];
+            if (y == x) {
+                equal++;
+                first = first && k >= i;
+            }
+        }
+        if (first) {
+            ties += (double)equal * equal * equal - equal;
+        }
+    }
+
+    double mean = 0.5 * n1 * n2;
+    double variance = n1 * n2 / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (variance <= 0.0) {
+        return 1.0;
+    }
+    double z = (u - mean - 0.5) / sqrt(variance);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+static void warn_setting(const char* what, const char* base, const char* now) {
+    if (strcmp(base, now) != 0) {
+        printf("Warning: baseline %s was %s, now %s, the timings may not be comparable\n", what, base, now);
+    }
+}
+
+int bench_compare(const char* path, const struct BenchReport* r, double threshold) {
+    struct Baseline b;
+    if (!read_baseline(path, &b)) {
+        return 1;
+    }
+
+    printf("Comparing with %s (revision %s), a scene regresses past %.1f%% slower\n", path, b.revision, threshold * 100.0);
+    char threads[32], size[32];
+    char base_threads[32], base_size[32];
+    snprintf(threads, sizeof(threads), "%ld", r->threads);
+    snprintf(base_threads, sizeof(base_threads), "%ld", b.threads);
+    snprintf(size, sizeof(size), "%dx%d", r->width, r->height);
+    snprintf(base_size, sizeof(base_size), "%dx%d", b.width, b.height);
+    warn_setting("threads", base_threads, threads);
+    warn_setting("SIMD target", b.simd_target, r->simd_target);
+    warn_setting("precision", b.precision, r->precision);
+    warn_setting("mode", b.mode, r->mode);
+    warn_setting("scene set", b.scene_set, r->scene_set);
+    warn_setting("size", base_size, size);
+
+    printf("------------------------------------------------------------------------------------\n");
+    printf("%-26s %11s %11s %9s %8s  %s\n", "Scene", "Base (ms)", "Now (ms)", "Change", "p", "Verdict");
+    printf("------------------------------------------------------------------------------------\n");
+
+    int regressions = 0;
+    for (int i = 0; i < r->scene_count; i++) {
+        const struct BenchSceneResult* s = &r->scenes[i];
+        const struct BaselineScene* base = NULL;
+        for (int k = 0; k < b.scene_count && !base; k++) {
+            base = strcmp(b.scenes[k].name, s->name) == 0 ? &b.scenes[k] : NULL;
+        }
+        if (!base) {
+            printf("%-26s %11s %11.1f %9s %8s  %s\n", s->name, "-", s->stats.median, "-", "-", "not in baseline");
+            continue;
+        }
+
+        struct BenchStats base_stats;
+        bench_stats(base->ms, base->runs, &base_stats);
+        double change = base_stats.median > 0.0 ? s->stats.median / base_stats.median - 1.0 : 0.0;
+        bool tested = base->runs >= BENCH_MIN_RUNS && s->stats.runs >= BENCH_MIN_RUNS;
+        double p = tested ? slower_p_value(base->ms, base->runs, s->runs_ms, s->stats.runs) : 0.0;
+
+        const char* verdict = "same";
+        if (change > threshold && p < BENCH_SIGNIFICANCE) {
+            verdict = "SLOWER";
+            regressions++;
+        } else if (change > threshold) {
+            verdict = "slower, within noise";
+        } else if (change < -threshold) {
+            verdict = "faster";
+        }
+        char p_text[16];
+        snprintf(p_text, sizeof(p_text), tested ? "%.3f" : "-", p);
+        printf("%-26s %11.1f %11.1f %+8.1f%% %8s  %s\n", s->name, base_stats.median, s->stats.median, change * 100.0, p_text, verdict);
+    }
+    printf("------------------------------------------------------------------------------------\n");
+    printf("%d of %d scenes regressed\n\n", regressions, r->scene_count);
+
+    free_baseline(&b);
+    return regressions > 0 ? 1 : 0;
+}
@@ -3,12 +3,14 @@
 #ifdef _WIN32
 #define HAVE_STRUCT_TIMESPEC
 #endif
+#include "bench_report.h"
 #include "colour_palette.h"
 #include "core_count.h"
 #include "inputHandler.h"
 #include "mandelbrot.h"
+#include "simd_handler.h"
+#include "thread_pool.h"
 
-#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -18,184 +20,317 @@
 
 struct BenchScene {
     const char* name;
-    double offset_x, offset_y;
+    const char* centre_x;  // decimal strings so deep scenes keep every digit
+    const char* centre_y;
     double zoom;
     int iterations;
 };
 
 static const struct BenchScene scenes[] = {
-    {"Mandelbrot Overview", -0.72, 0.0, 0.0032, 1000},
-    {"Satellite Microbrot", 0.356071294, -0.649363720, 0.000000126, 100000},
-    {"Whirlpool", -1.351936027, -0.040835814, 0.0000000001, 8500},
-    {"Hypercomplexity", 0.381671028, 0.136425822, 0.0000000003, 32000},
-    {"Tendrils", -0.567950683, -0.479570641, 0.0000000001, 17000},
+    {"Mandelbrot Overview", "-0.72", "0.0", 0.0032, 1000},
+    {"Satellite Microbrot", "0.356071294", "-0.649363720", 0.000000126, 100000},
+    {"Whirlpool", "-1.351936027", "-0.040835814", 0.0000000001, 8500},
+    {"Hypercomplexity", "0.381671028", "0.136425822", 0.0000000003, 32000},
+    {"Tendrils", "-0.567950683", "-0.479570641", 0.0000000001, 17000},
 };
 
-#define NUM_SCENES ((int)(sizeof(scenes) / sizeof(scenes[0])))
+// just past plain doubles, where double-double lanes take over; run with --precision double to see what they fix
+static const struct BenchScene mid_scenes[] = {
+    {"Misiurewicz i (1e-14)", "0.0", "1.0", 1e-14, 3000},
+    {"Misiurewicz M3,1 (1e-17)", "-1.54368901269207636157085597180174798652520329765", "0.0", 1e-17, 3000},
+    {"Misiurewicz i (1e-22)", "0.0", "1.0", 1e-22, 5000},
+    {"Misiurewicz M3,1 (1e-26)", "-1.54368901269207636157085597180174798652520329765", "0.0", 1e-26, 4000},
+};
+
+// past double precision, rendered by double-double or perturbation
+static const struct BenchScene deep_scenes[] = {
+    {"Misiurewicz i", "0.0", "1.0", 1e-20, 5000},
+    {"Misiurewicz i (1e-40)", "0.0", "1.0", 1e-40, 8000},
+    {"Misiurewicz M3,1", "-1.54368901269207636157085597180174798652520329765", "0.0", 1e-30, 4000},
+    {"Spike Tip", "-2.0", "0.0", 1e-30, 2000},
+};
+
+static const struct BenchScene* select_scenes(struct BenchmarkOpts opts, int* count) {
+    if (opts.mid) {
+        *count = (int)(sizeof(mid_scenes) / sizeof(mid_scenes[0]));
+        return mid_scenes;
+    }
+    if (opts.deep) {
+        *count = (int)(sizeof(deep_scenes) / sizeof(deep_scenes[0]));
+        return deep_scenes;
+    }
+    *count = (int)(sizeof(scenes) / sizeof(scenes[0]));
+    return scenes;
+}
+
+// time to post the pool's last frame again as a recolour, which reuses its iteration counts
+static double bench_recolour(struct ThreadPool* tp) {
+    struct RenderJob frame = tp->frame;
+    struct viewport vp = tp->frame_vp;
+    frame.vp = &vp;
+    frame.recolour = true;
+
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+
+    thread_pool_render(tp, &frame);
+    thread_pool_wait(tp);
+
+    timespec_get(&t1, TIME_UTC);
+
+    return (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+// time to post the pool's last frame again with twice the iteration limit, which carries on its saved orbits
+static double bench_raise(struct ThreadPool* tp) {
+    struct RenderJob frame = tp->frame;
+    struct viewport vp = tp->frame_vp;
+    vp.iterations *= 2;
+    frame.vp = &vp;
+
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+
+    thread_pool_render(tp, &frame);
+    thread_pool_wait(tp);
+
+    timespec_get(&t1, TIME_UTC);
+
+    return (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
 
 static double bench_scene(const struct BenchScene* scene, struct BenchmarkOpts opts, struct ThreadPool* tp, struct viewport* vp, Uint32* buffer,
                           Uint32* palette) {
-    vp->current_offset_x = scene->offset_x;
-    vp->current_offset_y = scene->offset_y;
+    struct apfloat centre_x, centre_y;
+    ap_from_string(&centre_x, scene->centre_x);
+    ap_from_string(&centre_y, scene->centre_y);
+    set_viewport_centre(vp, &centre_x, &centre_y);
     vp->zoom = scene->zoom;
     vp->iterations = scene->iterations;
 
-    ATOMIC_BOOL kill = false;
-    int rows_per_thread = SCRN_HEIGHT / tp->count;
-
-    for (int i = 0; i < tp->count; i++) {
-        tp->jobs[i].start_y = i * rows_per_thread;
-        tp->jobs[i].end_y = (i == tp->count - 1) ? SCRN_HEIGHT : (i + 1) * rows_per_thread;
-        tp->jobs[i].scrn_width = SCRN_WIDTH;
-        tp->jobs[i].vp = vp;
-        tp->jobs[i].palette = palette;
-        tp->jobs[i].palette_size = PALETTE_SIZE;
-        tp->jobs[i].render_smooth = opts.smooth;
-        tp->jobs[i].buffer = buffer;
-        tp->jobs[i].kill_signal = &kill;
-        tp->jobs[i].start_render_frac = 1;
-        tp->jobs[i].use_simd = !opts.scalar;
-        tp->jobs[i].no_optimisations = opts.no_optimisations;
-    }
+    // every run renders the scene in full, not as a zoom or pan of the scene before it
+    thread_pool_reset_reuse(tp);
+
+    struct RenderJob frame = {0};
+    frame.scrn_width = SCRN_WIDTH;
+    frame.vp = vp;
+    frame.palette = palette;
+    frame.palette_size = PALETTE_SIZE;
+    frame.render_smooth = opts.smooth;
+    frame.buffer = buffer;
+    frame.start_render_frac = opts.progressive ? 8 : 1;
+    frame.use_simd = !opts.scalar;
+    frame.no_optimisations = opts.no_optimisations;
+    frame.precision = opts.precision >= 0 ? (enum Precision)opts.precision : select_precision(vp);
+    frame.mariani_silver = opts.mariani_silver;
+    frame.solid_guess = opts.solid_guess;
+    frame.aa_samples = opts.aa_samples;
+    frame.aa_budget = opts.aa_budget;
 
     struct timespec t0, t1;
     timespec_get(&t0, TIME_UTC);
 
-    for (int i = 0; i < tp->count; i++) {
-        pthread_create(&tp->threads[i], NULL, calculateMandelbrotRoutine, &tp->jobs[i]);
-    }
-    for (int i = 0; i < tp->count; i++) {
-        pthread_join(tp->threads[i], NULL);
-    }
+    thread_pool_render(tp, &frame);
+    thread_pool_wait(tp);
 
     timespec_get(&t1, TIME_UTC);
 
     return (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
 }
 
-static double run_all_scenes(struct BenchmarkOpts opts, long thread_count,
-                             Uint32* buffer, struct viewport* vp, Uint32* palette) {
-    pthread_t* threads = calloc(thread_count, sizeof(pthread_t));
-    struct RenderJob* jobs = malloc(thread_count * sizeof(struct RenderJob));
-
-    if (!threads || !jobs) {
-        free(threads);
-        free(jobs);
+// imbalance is the summed busy time of the slowest thread over the summed mean, 1.0 is perfect
+static double run_all_scenes(struct BenchmarkOpts opts, long thread_count, int tile_size,
+                             Uint32* buffer, struct viewport* vp, Uint32* palette, double* imbalance) {
+    struct ThreadPool tp = {0};
+    if (thread_pool_init(&tp, thread_count, SCRN_WIDTH, SCRN_HEIGHT, tile_size) != 0) {
         return -1.0;
     }
 
-    for (int i = 0; i < thread_count; i++) {
-        jobs[i].iteration_out = malloc(SCRN_WIDTH * sizeof(int));
-        if (!jobs[i].iteration_out) {
-            for (int j = 0; j < i; j++)
-                free(jobs[j].iteration_out);
-            free(threads);
-            free(jobs);
-            return -1.0;
-        }
-    }
-
-    struct ThreadPool tp = {
-        .threads = threads,
-        .jobs = jobs,
-        .count = thread_count,
-        .kill = false,
-    };
+    int scene_count;
+    const struct BenchScene* list = select_scenes(opts, &scene_count);
 
     double total_ms = 0.0;
-    for (int i = 0; i < NUM_SCENES; i++) {
-        total_ms += bench_scene(&scenes[i], opts, &tp, vp, buffer, palette);
+    double busy_max = 0.0;
+    double busy_mean = 0.0;
+    for (int i = 0; i < scene_count; i++) {
+        total_ms += bench_scene(&list[i], opts, &tp, vp, buffer, palette);
+
+        double scene_max, scene_mean;
+        thread_pool_load_balance(&tp, &scene_max, &scene_mean);
+        busy_max += scene_max;
+        busy_mean += scene_mean;
     }
 
-    for (int i = 0; i < thread_count; i++)
-        free(jobs[i].iteration_out);
-    free(threads);
-    free(jobs);
+    thread_pool_destroy(&tp);
 
+    *imbalance = busy_mean > 0.0 ? busy_max / busy_mean : 1.0;
     return total_ms;
 }
 
-void run_benchmark(struct BenchmarkOpts opts) {
+int run_benchmark(struct BenchmarkOpts opts) {
     long thread_count = (opts.threads > 0) ? opts.threads : get_num_logical_cores();
+    int repeats = opts.repeats > 0 ? opts.repeats : 1;
+    int warmup = opts.warmup > 0 ? opts.warmup : 0;
+
+    int scene_count;
+    const struct BenchScene* list = select_scenes(opts, &scene_count);
 
     Uint32* buffer = malloc(sizeof(Uint32) * SCRN_WIDTH * SCRN_HEIGHT);
     struct viewport* vp = init_viewport(SCRN_WIDTH, SCRN_HEIGHT);
+    struct BenchSceneResult* results = calloc(scene_count, sizeof(struct BenchSceneResult));
+    double* runs = malloc((size_t)scene_count * repeats * sizeof(double));
 
-    if (!buffer || !vp) {
+    if (!buffer || !vp || !results || !runs) {
         fprintf(stderr, "benchmark: allocation failed\n");
         free(buffer);
         free(vp);
-        return;
+        free(results);
+        free(runs);
+        return 1;
     }
 
     Uint32 palette[PALETTE_SIZE];
     generateColourPalette(list_palettes[0], 8, palette, PALETTE_SIZE);
 
-    printf("\nMandelbrot Benchmark\n");
-    printf("Threads: %ld   Mode: %s\n", thread_count, opts.smooth ? "smooth" : "fast");
-    printf("----------------------------------------------------\n");
-    printf("%-26s %10s  %12s\n", "Scene", "Time (ms)", "Avg. iter/s (Millions)");
-    printf("----------------------------------------------------\n");
+    const char* simd_target = opts.scalar ? "none" : mandelbrot_simd_target();
+    const char* forced = opts.precision >= 0 ? precision_name((enum Precision)opts.precision) : "auto";
 
-    // Need per-scene timings for the detailed table, so allocate the pool here.
-    pthread_t* threads = calloc(thread_count, sizeof(pthread_t));
-    struct RenderJob* jobs = malloc(thread_count * sizeof(struct RenderJob));
-
-    if (!threads || !jobs) {
+    printf("\nMandelbrot Benchmark\n");
+    printf("Threads: %ld   Mode: %s   Tile: %d   Scenes: %s   Passes: %s   Fill: %s%s   AA: %d\n", thread_count, opts.smooth ? "smooth" : "fast",
+           opts.tile_size, opts.mid ? "mid" : opts.deep ? "deep" : "standard", opts.progressive ? "8-1" : "1",
+           opts.mariani_silver ? "mariani-silver " : "", opts.solid_guess ? "solid-guess" : opts.mariani_silver ? "" : "none", opts.aa_samples);
+    printf("SIMD: %s   Precision: %s   Size: %dx%d   Runs: %d after %d warmup   Revision: %s\n", simd_target, forced, SCRN_WIDTH,
+           SCRN_HEIGHT, repeats, warmup, bench_revision());
+    printf("----------------------------------------------------------------------------------------------------------------------------------------------\n");
+    printf("%-26s %10s %9s  %9s %7s  %-8s %5s %9s %9s %8s %8s %9s %9s\n", "Scene", "Time (ms)", "Computed", "Giter/s", "Lanes", "Prec.",
+           "Refs", "Glitched", "Skip/px", "Recolour", "x2 Iter", "Orbits", "AA smp");
+    printf("----------------------------------------------------------------------------------------------------------------------------------------------\n");
+
+    // same persistent pool as the viewer, started before timing begins
+    struct ThreadPool tp = {0};
+    if (thread_pool_init(&tp, thread_count, SCRN_WIDTH, SCRN_HEIGHT, opts.tile_size) != 0) {
         fprintf(stderr, "benchmark: allocation failed\n");
-        free(threads);
-        free(jobs);
         free(buffer);
         free(vp);
-        return;
+        free(results);
+        free(runs);
+        return 1;
     }
 
-    for (int i = 0; i < thread_count; i++) {
-        jobs[i].iteration_out = malloc(SCRN_WIDTH * sizeof(int));
-        if (!jobs[i].iteration_out) {
-            fprintf(stderr, "benchmark: iteration_out allocation failed\n");
-            for (int j = 0; j < i; j++)
-                free(jobs[j].iteration_out);
-            free(threads);
-            free(jobs);
-            free(buffer);
-            free(vp);
-            return;
+    double total_ms = 0.0;
+    struct IterationCounts total = {0};
+    long long total_dropped = 0;
+    long long total_aa_edges = 0;
+    long long total_aa_samples = 0;
+    size_t store_bytes = 0;
+    for (int i = 0; i < scene_count; i++) {
+        // the statistics below come from the last run, every run renders the same frame
+        struct BenchSceneResult* result = &results[i];
+        result->runs_ms = runs + (size_t)i * repeats;
+        for (int w = 0; w < warmup; w++) {
+            bench_scene(&list[i], opts, &tp, vp, buffer, palette);
+        }
+        for (int r = 0; r < repeats; r++) {
+            result->runs_ms[r] = bench_scene(&list[i], opts, &tp, vp, buffer, palette);
         }
+        bench_stats(result->runs_ms, repeats, &result->stats);
+        double ms = result->stats.median;
+        result->name = list[i].name;
+        result->precision = precision_name(tp.frame.precision);
+
+        // iterations the kernels actually took, every run takes the same; the lane steps they took them in
+        // give the share of SIMD lanes doing useful work
+        struct IterationCounts counts;
+        thread_pool_iteration_counts(&tp, &counts);
+        result->iterations = counts.iterations;
+        result->lane_steps = counts.lane_steps;
+        result->inside = counts.inside;
+        result->periodic = counts.periodic;
+        double giter_s = (double)counts.iterations / (ms / 1000.0) / 1e9;
+        double lanes = counts.lane_steps > 0 ? 100.0 * (double)counts.iterations / (double)counts.lane_steps : 0.0;
+
+        // reference orbits computed (0 = plain doubles), pixels no reference could resolve,
+        // and iterations per pixel jumped over by bilinear approximation
+        int references, glitched;
+        long long skipped;
+        thread_pool_perturbation_stats(&tp, &references, &glitched, &skipped);
+        double skip_per_pixel = (double)skipped / ((double)SCRN_WIDTH * SCRN_HEIGHT);
+
+        // share of the frame's pixels that were iterated rather than filled in
+        double computed = thread_pool_computed_fraction(&tp) * 100.0;
+
+        // extra samples anti-aliasing took for the scene's edge pixels
+        long long aa_edges, aa_samples;
+        thread_pool_aa_stats(&tp, &aa_edges, &aa_samples);
+        total_aa_edges += aa_edges;
+        total_aa_samples += aa_samples;
+
+        // palette or shading change on the finished scene, ms
+        double recolour_ms = bench_recolour(&tp);
+
+        // pixels at the limit whose orbits were saved, then the time to double the limit, ms
+        int orbits, dropped;
+        size_t orbit_bytes;
+        thread_pool_orbit_stats(&tp, &orbits, &dropped, &orbit_bytes);
+        double raise_ms = bench_raise(&tp);
+        printf("%-26s %10.1f %8.1f%%  %9.3f %6.1f%%  %-8s %5d %9d %9.1f %8.2f %8.1f %9d %9lld\n", list[i].name, ms, computed, giter_s, lanes,
+               precision_name(tp.frame.precision), references, glitched, skip_per_pixel, recolour_ms, raise_ms, orbits, aa_samples);
+        total_dropped += dropped;
+        store_bytes = orbit_bytes;
+        total_ms += ms;
+        total.iterations += counts.iterations;
+        total.lane_steps += counts.lane_steps;
+        total.inside += counts.inside;
+        total.periodic += counts.periodic;
     }
 
-    struct ThreadPool tp = {
-        .threads = threads,
-        .jobs = jobs,
-        .count = thread_count,
-        .kill = false,
-    };
-
-    double total_ms = 0.0;
-    double total_iters = 0.0;
-    for (int i = 0; i < NUM_SCENES; i++) {
-        double ms = bench_scene(&scenes[i], opts, &tp, vp, buffer, palette);
-        double scene_iters = (double)SCRN_WIDTH * SCRN_HEIGHT * scenes[i].iterations;
-        double avg_iter_s = scene_iters / (ms / 1000.0) / 1e6;
-        printf("%-26s %10.1f  %12.1f\n", scenes[i].name, ms, avg_iter_s);
-        total_ms += ms;
-        total_iters += scene_iters;
+    double avg_ms = total_ms / (double)scene_count;
+    double giter_s = total_ms > 0.0 ? (double)total.iterations / (total_ms / 1000.0) / 1e9 : 0.0;
+    double lanes = total.lane_steps > 0 ? 100.0 * (double)total.iterations / (double)total.lane_steps : 0.0;
+    printf("----------------------------------------------------------------------------------------------------------------------------------------------\n");
+    printf("%-26s %10.1f %9s  %9.3f %6.1f%%\n", "Avg", avg_ms, "", giter_s, lanes);
+    printf("%-26s %10.1f %9s  %9s %7s\n", "Total", total_ms, "", "-", "-");
+    printf("----------------------------------------------------------------------------------------------------------------------------------------------\n");
+    printf("\nGiter/s: billions of z^2 + c steps the kernels took per second\n");
+    printf("Lanes: iterations / SIMD lane steps, the share of lane steps doing useful work rather than idling in a finished lane\n");
+    printf("Answered early: %lld pixels by the cardioid and bulb test, %lld by the periodicity check\n", total.inside, total.periodic);
+    printf("x2 Iter: ms to double the limit of the finished scene. Orbits: pixels at the limit saved to resume from\n");
+    printf("Orbit store: %.1f MB, %lld pixels at the limit didn't fit\n", (double)store_bytes / (1024.0 * 1024.0), total_dropped);
+    printf("AA smp: extra samples averaged into edge pixels, %lld samples over %lld edge pixels in all\n\n", total_aa_samples, total_aa_edges);
+
+    if (repeats > 1) {
+        printf("Time (ms) is the median of %d runs\n", repeats);
+        printf("------------------------------------------------------------------------------\n");
+        printf("%-26s %9s %9s %9s %9s %9s\n", "Scene", "Min", "Median", "P95", "Mean", "Stddev");
+        printf("------------------------------------------------------------------------------\n");
+        for (int i = 0; i < scene_count; i++) {
+            const struct BenchStats* s = &results[i].stats;
+            printf("%-26s %9.1f %9.1f %9.1f %9.1f %9.2f\n", results[i].name, s->min, s->median, s->p95, s->mean, s->stddev);
+        }
+        printf("------------------------------------------------------------------------------\n\n");
     }
 
-    double avg_ms = total_ms / (double)NUM_SCENES;
-    double avg_iter_s = total_iters / (total_ms / 1000.0) / 1e6;
-    printf("----------------------------------------------------\n");
-    printf("%-26s %10.1f  %12.1f\n", "Avg", avg_ms, avg_iter_s);
-    printf("%-26s %10.1f  %12s\n", "Total", total_ms, "-");
-    printf("----------------------------------------------------\n");
-    printf("\nNote: Avg. million iterations/second assumes no bailout, and therefore is an optimistic measurement\n\n");
+    struct BenchReport report = {.threads = thread_count, .simd_target = simd_target, .precision = forced,
+                                 .mode = opts.smooth ? "smooth" : "fast", .scene_set = opts.mid ? "mid" : opts.deep ? "deep" : "standard",
+                                 .width = SCRN_WIDTH, .height = SCRN_HEIGHT, .warmup = warmup, .repeats = repeats, .scenes = results,
+                                 .scene_count = scene_count};
+    int status = 0;
+    if (opts.report && bench_write_report(opts.report, &report) != 0) {
+        status = 1;
+    }
+    if (opts.save_baseline && bench_save_baseline(opts.save_baseline, &report) != 0) {
+        status = 1;
+    }
+    if (opts.compare && bench_compare(opts.compare, &report, opts.threshold) != 0) {
+        status = 1;
+    }
 
-    for (int i = 0; i < thread_count; i++)
-        free(jobs[i].iteration_out);
-    free(threads);
-    free(jobs);
+    thread_pool_destroy(&tp);
     free(buffer);
     free(vp);
+    free(results);
+    free(runs);
+    return status;
 }
 
 void run_sweep(struct BenchmarkOpts opts) {
@@ -216,23 +351,152 @@ void run_sweep(struct BenchmarkOpts opts) {
 
     printf("\nMandelbrot Thread Sweep  (1-%ld threads, %s mode)\n",
            max_threads, opts.smooth ? "smooth" : "fast");
-    printf("------------------------------------------\n");
-    printf("%-10s %12s  %10s\n", "Threads", "Total (ms)", "Speedup");
-    printf("------------------------------------------\n");
+    printf("Bands: one static band per thread   Tiles: %dpx tiles with work stealing\n", opts.tile_size);
+    printf("Imbal.: busiest thread / mean busy time per thread\n");
+    printf("--------------------------------------------------------------------\n");
+    printf("%-10s %12s %8s  %12s %8s  %10s\n", "Threads", "Bands (ms)", "Imbal.", "Tiles (ms)", "Imbal.", "Speedup");
+    printf("--------------------------------------------------------------------\n");
 
     double baseline_ms = -1.0;
     for (long t = 1; t <= max_threads; t++) {
-        double total_ms = run_all_scenes(opts, t, buffer, vp, palette);
-        if (total_ms < 0.0) {
+        double band_imbalance, tile_imbalance;
+        double band_ms = run_all_scenes(opts, t, 0, buffer, vp, palette, &band_imbalance);
+        double tile_ms = run_all_scenes(opts, t, opts.tile_size, buffer, vp, palette, &tile_imbalance);
+        if (band_ms < 0.0 || tile_ms < 0.0) {
             fprintf(stderr, "benchmark: allocation failed for %ld threads\n", t);
             break;
         }
-        if (baseline_ms < 0.0) baseline_ms = total_ms;
-        printf("%-10ld %12.1f  %9.2fx\n", t, total_ms, baseline_ms / total_ms);
+        if (baseline_ms < 0.0) baseline_ms = tile_ms;
+        printf("%-10ld %12.1f %8.2f  %12.1f %8.2f  %9.2fx\n", t, band_ms, band_imbalance, tile_ms, tile_imbalance,
+               baseline_ms / tile_ms);
     }
 
-    printf("------------------------------------------\n\n");
+    printf("--------------------------------------------------------------------\n\n");
 
     free(buffer);
     free(vp);
 }
+
+// views the kernel benchmark iterates rows of, shallow enough for plain doubles
+struct KernelView {
+    const char* name;
+    double centre_x, centre_y;
+    double zoom;
+    int iterations;
+};
+
+static const struct KernelView kernel_views[] = {
+    {"Overview", -0.72, 0.0, 0.0032, 1000},
+    {"Seahorse Valley", -0.743643887, 0.131825904, 0.000002, 4000},
+    {"Elephant Valley", 0.2925, 0.0149, 0.000002, 4000},
+};
+
+#define KERNEL_ROWS 32         // rows of each view, spread evenly down the screen
+#define KERNEL_MAX_TARGETS 32  // one per target bit Highway has
+
+// one pass over a view's rows, by SimdRow on whichever target is forced or by the scalar loop, ms
+static double kernel_rows(const struct KernelView* view, bool scalar, bool no_optimisations, int* out, struct IterationCounts* counts) {
+    double x0 = view->centre_x - (SCRN_WIDTH / 2) * view->zoom;
+
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+
+    for (int r = 0; r < KERNEL_ROWS; r++) {
+        int y = r * SCRN_HEIGHT / KERNEL_ROWS;
+        double y0 = view->centre_y + (y - SCRN_HEIGHT / 2) * view->zoom;
+        if (scalar) {
+            for (int px = 0; px < SCRN_WIDTH; px++) {
+                out[px] = continueMandelbrot(x0 + px * view->zoom, y0, view->iterations, no_optimisations, NULL, counts);
+            }
+        } else {
+            mandelbrot_simd_row(x0, y0, view->zoom, view->iterations, out, SCRN_WIDTH, no_optimisations, NULL, NULL, counts);
+        }
+    }
+
+    timespec_get(&t1, TIME_UTC);
+
+    return (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+int run_kernel_bench(struct BenchmarkOpts opts) {
+    int repeats = opts.repeats > 0 ? opts.repeats : 1;
+    int warmup = opts.warmup > 0 ? opts.warmup : 0;
+    int view_count = (int)(sizeof(kernel_views) / sizeof(kernel_views[0]));
+
+    const char* targets[KERNEL_MAX_TARGETS];
+    int target_count = 1;
+    if (opts.simd_target) {
+        targets[0] = opts.simd_target;
+    } else {
+        target_count = mandelbrot_simd_targets(targets, KERNEL_MAX_TARGETS);
+        if (target_count > KERNEL_MAX_TARGETS) {
+            target_count = KERNEL_MAX_TARGETS;
+        }
+    }
+
+    int* out = malloc(sizeof(int) * SCRN_WIDTH);
+    double* runs = malloc(sizeof(double) * repeats);
+    if (!out || !runs) {
+        fprintf(stderr, "benchmark: allocation failed\n");
+        free(out);
+        free(runs);
+        return 1;
+    }
+
+    printf("\nMandelbrot Kernel Benchmark\n");
+    printf("Kernel: SimdRow   Threads: 1, no colouring   Rows: %d of %dpx per view   Runs: %d after %d warmup   Revision: %s\n", KERNEL_ROWS,
+           SCRN_WIDTH, repeats, warmup, bench_revision());
+    printf("----------------------------------------------------------------------------------------------------\n");
+    printf("%-12s", "Target");
+    for (int v = 0; v < view_count; v++) {
+        printf(" %16s", kernel_views[v].name);
+    }
+    printf(" %9s %7s %10s\n", "All", "Lanes", "vs scalar");
+    printf("----------------------------------------------------------------------------------------------------\n");
+
+    // the scalar loop first, then every target best first or just the forced one
+    double scalar_ns = 0.0;
+    for (int t = -1; t < target_count; t++) {
+        bool scalar = t < 0;
+        if (!scalar) {
+            mandelbrot_simd_set_target(targets[t]);
+        }
+        printf("%-12s", scalar ? "scalar C" : targets[t]);
+
+        struct IterationCounts all = {0};
+        double all_ms = 0.0;
+        for (int v = 0; v < view_count; v++) {
+            struct IterationCounts counts = {0};
+            for (int w = 0; w < warmup; w++) {
+                kernel_rows(&kernel_views[v], scalar, opts.no_optimisations, out, &counts);
+            }
+            // every run takes the same iterations, the last run's are kept
+            for (int r = 0; r < repeats; r++) {
+                counts = (struct IterationCounts){0};
+                runs[r] = kernel_rows(&kernel_views[v], scalar, opts.no_optimisations, out, &counts);
+            }
+
+            struct BenchStats stats;
+            bench_stats(runs, repeats, &stats);
+            printf(" %16.3f", counts.iterations > 0 ? stats.median * 1e6 / (double)counts.iterations : 0.0);
+            all_ms += stats.median;
+            all.iterations += counts.iterations;
+            all.lane_steps += counts.lane_steps;
+        }
+
+        double ns = all.iterations > 0 ? all_ms * 1e6 / (double)all.iterations : 0.0;
+        double lanes = all.lane_steps > 0 ? 100.0 * (double)all.iterations / (double)all.lane_steps : 0.0;
+        if (scalar) {
+            scalar_ns = ns;
+        }
+        printf(" %9.3f %6.1f%% %9.2fx\n", ns, lanes, ns > 0.0 ? scalar_ns / ns : 0.0);
+    }
+    mandelbrot_simd_set_target(opts.simd_target);
+
+    printf("----------------------------------------------------------------------------------------------------\n");
+    printf("ns per iteration at the median run. Lanes: share of SIMD lane steps taking an iteration\n\n");
+
+    free(out);
+    free(runs);
+    return 0;
+}
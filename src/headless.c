@@ -0,0 +1,535 @@
+#include "headless.h"
+
+#ifdef _WIN32
+#define HAVE_STRUCT_TIMESPEC
+#endif
+#include "colour_palette.h"
+#include "core_count.h"
+#include "image_writer.h"
+#include "inputHandler.h"
+#include "mandelbrot.h"
+#include "thread_pool.h"
+#include "tiled_image.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_BAND_ROWS 256
+#define DEFAULT_POSTER_TILE 512
+
+// post the part of the image whose top left pixel is (first_col, first_row): the pool's screen is that part's
+// size, so its centre moves across the image by whole pixels and every pixel keeps the position it has in the full image
+static void post_region(struct ThreadPool* tp, struct RenderJob* frame, struct viewport* vp, const struct HeadlessOpts* opts,
+                        const struct apfloat* centre_x, const struct apfloat* centre_y, long long first_col, long long first_row,
+                        Uint32* buffer) {
+    struct apfloat region_x, region_y;
+    ap_add_double(&region_x, centre_x, (double)(first_col + vp->screen_width / 2 - opts->width / 2) * vp->zoom);
+    ap_add_double(&region_y, centre_y, (double)(first_row + vp->screen_height / 2 - opts->height / 2) * vp->zoom);
+    set_viewport_centre(vp, &region_x, &region_y);
+
+    frame->buffer = buffer;
+    thread_pool_render(tp, frame);
+}
+
+static bool check_opts(const struct HeadlessOpts* opts, struct apfloat* centre_x, struct apfloat* centre_y) {
+    if (opts->width <= 0 || opts->height <= 0 || opts->zoom <= 0.0 || opts->iterations <= 0) {
+        fprintf(stderr, "render: size, zoom and iterations must be positive\n");
+        return false;
+    }
+    if (opts->palette < 0 || opts->palette >= NUM_PALETTES) {
+        fprintf(stderr, "render: palette must be 0-%d\n", NUM_PALETTES - 1);
+        return false;
+    }
+    if (!ap_from_string(centre_x, opts->centre_x) || !ap_from_string(centre_y, opts->centre_y)) {
+        fprintf(stderr, "render: malformed centre %s, %s\n", opts->centre_x, opts->centre_y);
+        return false;
+    }
+    return true;
+}
+
+// arithmetic is chosen once for the whole image, so bands or tiles can't disagree at their seams
+static enum Precision image_precision(const struct HeadlessOpts* opts, const struct viewport* vp, const struct apfloat* centre_x,
+                                      const struct apfloat* centre_y) {
+    if (opts->precision >= 0) {
+        return (enum Precision)opts->precision;
+    }
+    struct viewport full = *vp;
+    full.screen_width = opts->width;
+    full.screen_height = opts->height;
+    set_viewport_centre(&full, centre_x, centre_y);
+    return select_precision(&full);
+}
+
+static void init_frame(struct RenderJob* frame, const struct HeadlessOpts* opts, struct viewport* vp, Uint32* palette,
+                       enum Precision precision) {
+    *frame = (struct RenderJob){0};
+    frame->scrn_width = vp->screen_width;
+    frame->vp = vp;
+    frame->palette = palette;
+    frame->palette_size = PALETTE_SIZE;
+    frame->render_smooth = opts->smooth;
+    frame->start_render_frac = 1;
+    frame->use_simd = true;
+    frame->precision = precision;
+    frame->mariani_silver = opts->mariani_silver;
+    frame->aa_samples = opts->aa_samples;
+    frame->aa_budget = opts->aa_budget;
+}
+
+static double seconds_since(const struct timespec* t0) {
+    struct timespec t1;
+    timespec_get(&t1, TIME_UTC);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+int run_headless(struct HeadlessOpts opts) {
+    struct apfloat centre_x, centre_y;
+    if (!check_opts(&opts, &centre_x, &centre_y)) {
+        return 1;
+    }
+
+    long thread_count = (opts.threads > 0) ? opts.threads : get_num_logical_cores();
+    int band_rows = opts.band_rows > 0 ? opts.band_rows : DEFAULT_BAND_ROWS;
+    band_rows = band_rows > opts.height ? opts.height : band_rows;
+    int band_count = (opts.height + band_rows - 1) / band_rows;
+
+    // one band is written out while the next renders into the other buffer
+    size_t band_pixels = (size_t)opts.width * band_rows;
+    Uint32* buffers[2] = {malloc(band_pixels * sizeof(Uint32)), malloc(band_pixels * sizeof(Uint32))};
+    struct viewport* vp = init_viewport(opts.width, band_rows);
+    if (!buffers[0] || !buffers[1] || !vp) {
+        fprintf(stderr, "render: allocation failed\n");
+        free(buffers[0]);
+        free(buffers[1]);
+        free(vp);
+        return 1;
+    }
+    vp->zoom = opts.zoom;
+    vp->iterations = opts.iterations;
+    enum Precision precision = image_precision(&opts, vp, &centre_x, &centre_y);
+
+    Uint32 palette[PALETTE_SIZE];
+    generateColourPalette(list_palettes[opts.palette], 8, palette, PALETTE_SIZE);
+
+    struct ThreadPool tp = {0};
+    if (thread_pool_init(&tp, thread_count, opts.width, band_rows, opts.tile_size) != 0) {
+        free(buffers[0]);
+        free(buffers[1]);
+        free(vp);
+        return 1;
+    }
+
+    struct ImageWriter* image = image_open(opts.output, opts.width, opts.height);
+    if (!image) {
+        thread_pool_destroy(&tp);
+        free(buffers[0]);
+        free(buffers[1]);
+        free(vp);
+        return 1;
+    }
+
+    printf("Rendering %dx%d to %s: %s, %d iterations, %d bands of %d rows, %ld threads\n", opts.width, opts.height, opts.output,
+           precision_name(precision), opts.iterations, band_count, band_rows, thread_count);
+
+    struct RenderJob frame;
+    init_frame(&frame, &opts, vp, palette, precision);
+
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+
+    int status = 0;
+    double computed = 0.0;
+    long long aa_edges = 0, aa_samples = 0;
+    post_region(&tp, &frame, vp, &opts, &centre_x, &centre_y, 0, 0, buffers[0]);
+    for (int band = 0; band < band_count && status == 0; band++) {
+        thread_pool_wait(&tp);
+        computed += thread_pool_computed_fraction(&tp) * (double)band_pixels;
+        long long band_edges, band_samples;
+        thread_pool_aa_stats(&tp, &band_edges, &band_samples);
+        aa_edges += band_edges;
+        aa_samples += band_samples;
+        if (band + 1 < band_count) {
+            post_region(&tp, &frame, vp, &opts, &centre_x, &centre_y, 0, (long long)(band + 1) * band_rows, buffers[(band + 1) % 2]);
+        }
+
+        // the last band runs past the bottom of the image, only its rows inside are written
+        status = image_write_rows(image, buffers[band % 2], band_rows);
+        printf("\r  band %d/%d", band + 1, band_count);
+        fflush(stdout);
+    }
+    printf("\n");
+
+    // a write error leaves the next band in flight
+    thread_pool_wait(&tp);
+    if (image_close(image) != 0) {
+        status = 1;
+    }
+
+    double seconds = seconds_since(&t0);
+
+    if (status == 0) {
+        double pixels = (double)opts.width * opts.height;
+        printf("Done in %.2f s: %.1f Mpixel/s, %.1f%% of pixels iterated, %.1f MB of band buffers\n", seconds, pixels / seconds / 1e6,
+               computed / ((double)band_pixels * band_count) * 100.0, 2.0 * band_pixels * sizeof(Uint32) / (1024.0 * 1024.0));
+        if (opts.aa_samples > 0) {
+            printf("Anti-aliasing: %lld extra samples over %lld edge pixels\n", aa_samples, aa_edges);
+        }
+    } else {
+        fprintf(stderr, "render: writing %s failed\n", opts.output);
+    }
+
+    thread_pool_destroy(&tp);
+    free(buffers[0]);
+    free(buffers[1]);
+    free(vp);
+    return status;
+}
+
+// fnv-1a of everything that decides a pixel's colour, so a resumed poster can't mix two different renders
+static uint64_t settings_key(const struct HeadlessOpts* opts, enum Precision precision) {
+    char settings[512];
+    snprintf(settings, sizeof(settings), "%s %s %.17g %d %d %d %d %d %d %d", opts->centre_x, opts->centre_y, opts->zoom,
+             opts->iterations, opts->palette, opts->smooth, (int)precision, opts->mariani_silver, opts->aa_samples, opts->aa_budget);
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* c = settings; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+int run_poster(struct HeadlessOpts opts) {
+    struct apfloat centre_x, centre_y;
+    if (!check_opts(&opts, &centre_x, &centre_y)) {
+        return 1;
+    }
+
+    long thread_count = (opts.threads > 0) ? opts.threads : get_num_logical_cores();
+    struct viewport* vp = init_viewport(opts.width, opts.height);
+    if (!vp) {
+        fprintf(stderr, "render: allocation failed\n");
+        return 1;
+    }
+    vp->zoom = opts.zoom;
+    vp->iterations = opts.iterations;
+    enum Precision precision = image_precision(&opts, vp, &centre_x, &centre_y);
+
+    int poster_tile = opts.poster_tile > 0 ? opts.poster_tile : DEFAULT_POSTER_TILE;
+    struct TiledImage* image = tiled_open(opts.output, opts.width, opts.height, poster_tile, settings_key(&opts, precision));
+    if (!image) {
+        free(vp);
+        return 1;
+    }
+
+    // the pool's screen is one tile, drawn straight into the mapping
+    int tile_size = (int)image->header.tile_size;
+    int tiles_x = (int)image->header.tiles_x;
+    vp->screen_width = tile_size;
+    vp->screen_height = tile_size;
+
+    Uint32 palette[PALETTE_SIZE];
+    generateColourPalette(list_palettes[opts.palette], 8, palette, PALETTE_SIZE);
+
+    struct ThreadPool tp = {0};
+    if (thread_pool_init(&tp, thread_count, tile_size, tile_size, opts.tile_size) != 0) {
+        tiled_close(image);
+        free(vp);
+        return 1;
+    }
+
+    int already_done = image->tiles_done;
+    printf("Rendering %dx%d to %s: %s, %d iterations, %d tiles of %d, %d already done, %ld threads\n", opts.width, opts.height,
+           opts.output, precision_name(precision), opts.iterations, image->tile_count, tile_size, already_done, thread_count);
+
+    struct RenderJob frame;
+    init_frame(&frame, &opts, vp, palette, precision);
+
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+
+    // tile k is flushed and marked done while tile k + 1 renders
+    int status = 0;
+    int rendering = -1;
+    for (int tile = 0; tile <= image->tile_count && status == 0; tile++) {
+        if (tile < image->tile_count && image->done[tile] == 1) {
+            continue;
+        }
+        int finished = rendering;
+        if (finished >= 0) {
+            thread_pool_wait(&tp);
+        }
+        rendering = -1;
+        if (tile < image->tile_count) {
+            post_region(&tp, &frame, vp, &opts, &centre_x, &centre_y, (long long)(tile % tiles_x) * tile_size,
+                        (long long)(tile / tiles_x) * tile_size, tiled_tile(image, tile));
+            rendering = tile;
+        }
+        if (finished >= 0) {
+            status = tiled_finish_tile(image, finished);
+            printf("\r  tile %d/%d", image->tiles_done, image->tile_count);
+            fflush(stdout);
+        }
+    }
+    printf("\n");
+
+    // a flush error leaves the next tile in flight
+    thread_pool_wait(&tp);
+    double seconds = seconds_since(&t0);
+    int rendered = image->tiles_done - already_done;
+    if (tiled_close(image) != 0) {
+        status = 1;
+    }
+
+    if (status == 0) {
+        double pixels = (double)rendered * tile_size * tile_size;
+        printf("Done in %.2f s: %d tiles rendered, %.1f Mpixel/s\n", seconds, rendered, seconds > 0.0 ? pixels / seconds / 1e6 : 0.0);
+    } else {
+        fprintf(stderr, "render: writing %s failed, run again to carry on from the tiles that were saved\n", opts.output);
+    }
+
+    thread_pool_destroy(&tp);
+    free(vp);
+    return status;
+}
+
+struct Keyframe {
+    double time;
+    struct apfloat centre_x, centre_y;
+    double zoom;
+};
+
+// one keyframe per line, "time centre_x centre_y zoom", with # starting a comment; returns the count, 0 on error
+static int read_keyframes(const char* path, struct Keyframe** out) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "animate: can't open %s\n", path);
+        return 0;
+    }
+
+    struct Keyframe* keys = NULL;
+    int count = 0, capacity = 0;
+    char line[1024];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line_number++;
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char x[512], y[512];
+        struct Keyframe key;
+        int fields = sscanf(line, "%lf %511s %511s %lf", &key.time, x, y, &key.zoom);
+        if (fields <= 0) {
+            continue;  // blank
+        }
+        if (fields != 4 || key.zoom <= 0.0 || !ap_from_string(&key.centre_x, x) || !ap_from_string(&key.centre_y, y)) {
+            fprintf(stderr, "animate: %s:%d should be \"time centre_x centre_y zoom\"\n", path, line_number);
+            ok = false;
+        } else if (count > 0 && key.time <= keys[count - 1].time) {
+            fprintf(stderr, "animate: %s:%d keyframe times must increase\n", path, line_number);
+            ok = false;
+        } else {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                struct Keyframe* grown = realloc(keys, (size_t)capacity * sizeof(struct Keyframe));
+                if (!grown) {
+                    fprintf(stderr, "animate: allocation failed\n");
+                    ok = false;
+                    break;
+                }
+                keys = grown;
+            }
+            keys[count++] = key;
+        }
+    }
+    fclose(file);
+
+    if (ok && count == 0) {
+        fprintf(stderr, "animate: %s has no keyframes\n", path);
+    }
+    if (!ok || count == 0) {
+        free(keys);
+        return 0;
+    }
+    *out = keys;
+    return count;
+}
+
+// view at time t: zoom is interpolated in log space, and the centre so that each segment scales the image
+// about one fixed point, which keeps consecutive frames resampling cleanly into each other
+static void view_at(const struct Keyframe* keys, int count, double t, struct apfloat* centre_x, struct apfloat* centre_y, double* zoom) {
+    int i = 0;
+    while (i + 2 < count && t > keys[i + 1].time) {
+        i++;
+    }
+    if (count == 1) {
+        *centre_x = keys[0].centre_x;
+        *centre_y = keys[0].centre_y;
+        *zoom = keys[0].zoom;
+        return;
+    }
+
+    const struct Keyframe* a = &keys[i];
+    const struct Keyframe* b = &keys[i + 1];
+    double s = (t - a->time) / (b->time - a->time);
+    s = s < 0.0 ? 0.0 : s > 1.0 ? 1.0 : s;
+    *zoom = s == 0.0 ? a->zoom : s == 1.0 ? b->zoom : exp(log(a->zoom) + s * (log(b->zoom) - log(a->zoom)));
+
+    // share of the way from a's centre to b's; each end is reached from the nearer keyframe, so the offset
+    // stays small next to the pixel size however deep b is
+    double toward_b = a->zoom != b->zoom ? (a->zoom - *zoom) / (a->zoom - b->zoom) : s;
+    double toward_a = a->zoom != b->zoom ? (*zoom - b->zoom) / (a->zoom - b->zoom) : 1.0 - s;
+    const struct Keyframe* from = toward_b <= 0.5 ? a : b;
+    const struct Keyframe* to = toward_b <= 0.5 ? b : a;
+    double share = toward_b <= 0.5 ? toward_b : toward_a;
+
+    struct apfloat delta;
+    ap_sub(&delta, &to->centre_x, &from->centre_x);
+    ap_add_double(centre_x, &from->centre_x, ap_to_double(&delta) * share);
+    ap_sub(&delta, &to->centre_y, &from->centre_y);
+    ap_add_double(centre_y, &from->centre_y, ap_to_double(&delta) * share);
+}
+
+// output pattern must hold exactly one integer conversion such as %05d, for the frame number
+static bool valid_pattern(const char* pattern) {
+    int conversions = 0;
+    for (const char* c = pattern; *c; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        if (c[1] == '%') {
+            c++;
+            continue;
+        }
+        c++;
+        while (*c == '0' || *c == '-' || *c == ' ' || *c == '+' || (*c >= '1' && *c <= '9')) {
+            c++;
+        }
+        if (*c != 'd') {
+            return false;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+static int write_frame(const char* pattern, int index, const Uint32* pixels, int width, int height) {
+    char path[4096];
+    snprintf(path, sizeof(path), pattern, index);
+    struct ImageWriter* image = image_open(path, width, height);
+    if (!image) {
+        return 1;
+    }
+    int status = image_write_rows(image, pixels, height);
+    if (image_close(image) != 0) {
+        status = 1;
+    }
+    return status;
+}
+
+int run_animation(struct HeadlessOpts opts) {
+    if (opts.width <= 0 || opts.height <= 0 || opts.frames <= 0) {
+        fprintf(stderr, "animate: size and frame count must be positive\n");
+        return 1;
+    }
+    if (opts.palette < 0 || opts.palette >= NUM_PALETTES) {
+        fprintf(stderr, "animate: palette must be 0-%d\n", NUM_PALETTES - 1);
+        return 1;
+    }
+    if (!valid_pattern(opts.output)) {
+        fprintf(stderr, "animate: output %s needs one %%d for the frame number, e.g. zoom_%%05d.png\n", opts.output);
+        return 1;
+    }
+
+    struct Keyframe* keys = NULL;
+    int key_count = read_keyframes(opts.keyframes, &keys);
+    if (key_count == 0) {
+        return 1;
+    }
+
+    long thread_count = (opts.threads > 0) ? opts.threads : get_num_logical_cores();
+
+    // frame k is written out of one buffer while frame k + 1 renders into the other
+    size_t frame_pixels = (size_t)opts.width * opts.height;
+    Uint32* buffers[2] = {malloc(frame_pixels * sizeof(Uint32)), malloc(frame_pixels * sizeof(Uint32))};
+    struct viewport* vp = init_viewport(opts.width, opts.height);
+    if (!buffers[0] || !buffers[1] || !vp) {
+        fprintf(stderr, "animate: allocation failed\n");
+        free(buffers[0]);
+        free(buffers[1]);
+        free(vp);
+        free(keys);
+        return 1;
+    }
+
+    Uint32 palette[PALETTE_SIZE];
+    generateColourPalette(list_palettes[opts.palette], 8, palette, PALETTE_SIZE);
+
+    struct ThreadPool tp = {0};
+    if (thread_pool_init(&tp, thread_count, opts.width, opts.height, opts.tile_size) != 0) {
+        free(buffers[0]);
+        free(buffers[1]);
+        free(vp);
+        free(keys);
+        return 1;
+    }
+
+    double t0_key = keys[0].time;
+    double t1_key = keys[key_count - 1].time;
+    printf("Animating %d frames of %dx%d to %s: %d keyframes over %.2f s, %ld threads\n", opts.frames, opts.width, opts.height,
+           opts.output, key_count, t1_key - t0_key, thread_count);
+
+    struct RenderJob frame;
+    init_frame(&frame, &opts, vp, palette, PRECISION_DOUBLE);
+
+    struct timespec t0;
+    timespec_get(&t0, TIME_UTC);
+
+    // the pool seeds each frame from the last one's counts, resampled to its zoom (see REPROJECT_PASS)
+    int status = 0;
+    double computed = 0.0;
+    for (int k = 0; k <= opts.frames && status == 0; k++) {
+        if (k > 0) {
+            thread_pool_wait(&tp);
+            computed += thread_pool_computed_fraction(&tp);
+        }
+        if (k < opts.frames) {
+            double t = opts.frames > 1 ? t0_key + (t1_key - t0_key) * k / (opts.frames - 1) : t0_key;
+            struct apfloat centre_x, centre_y;
+            view_at(keys, key_count, t, &centre_x, &centre_y, &vp->zoom);
+            vp->iterations = opts.iterations > 0 ? opts.iterations : calculateIterations(vp->zoom);
+            set_viewport_centre(vp, &centre_x, &centre_y);
+            frame.precision = opts.precision >= 0 ? (enum Precision)opts.precision : select_precision(vp);
+            frame.buffer = buffers[k % 2];
+            thread_pool_render(&tp, &frame);
+        }
+        if (k > 0) {
+            status = write_frame(opts.output, k - 1, buffers[(k - 1) % 2], opts.width, opts.height);
+            printf("\r  frame %d/%d", k, opts.frames);
+            fflush(stdout);
+        }
+    }
+    printf("\n");
+
+    // a write error leaves the next frame in flight
+    thread_pool_wait(&tp);
+    double seconds = seconds_since(&t0);
+
+    if (status == 0) {
+        printf("Done in %.2f s: %.2f frames/s, %.1f Mpixel/s, %.1f%% of pixels iterated\n", seconds, opts.frames / seconds,
+               (double)frame_pixels * opts.frames / seconds / 1e6, computed / opts.frames * 100.0);
+    } else {
+        fprintf(stderr, "animate: writing frames to %s failed\n", opts.output);
+    }
+
+    thread_pool_destroy(&tp);
+    free(buffers[0]);
+    free(buffers[1]);
+    free(vp);
+    free(keys);
+    return status;
+}
@@ -0,0 +1,236 @@
+#include "image_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// largest stored deflate block
+#define STORED_BLOCK_MAX 65535
+
+// adler-32 sums stay below 2^32 for this many bytes between reductions
+#define ADLER_RUN 5552
+
+static uint32_t crc_table[256];
+static bool crc_ready = false;
+
+static void build_crc_table(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+    crc_ready = true;
+}
+
+static bool ends_with_ppm(const char* path) {
+    size_t len = strlen(path);
+    if (len < 4) {
+        return false;
+    }
+    const char* ext = path + len - 4;
+    return ext[0] == '.' && (ext[1] | 0x20) == 'p' && (ext[2] | 0x20) == 'p' && (ext[3] | 0x20) == 'm';
+}
+
+static void put_be32(unsigned char* out, uint32_t value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+// bytes of the open chunk, counted into its crc
+static void chunk_put(struct ImageWriter* w, const unsigned char* data, size_t count) {
+    uint32_t c = w->crc;
+    for (size_t i = 0; i < count; i++) {
+        c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+    w->crc = c;
+    fwrite(data, 1, count, w->file);
+}
+
+static void chunk_begin(struct ImageWriter* w, const char* type, uint32_t length) {
+    unsigned char header[4];
+    put_be32(header, length);
+    fwrite(header, 1, 4, w->file);
+    w->crc = 0xFFFFFFFFu;
+    chunk_put(w, (const unsigned char*)type, 4);
+}
+
+static void chunk_end(struct ImageWriter* w) {
+    unsigned char crc[4];
+    put_be32(crc, w->crc ^ 0xFFFFFFFFu);
+    fwrite(crc, 1, 4, w->file);
+}
+
+static void adler_update(struct ImageWriter* w, const unsigned char* data, size_t count) {
+    uint32_t a = w->adler_a;
+    uint32_t b = w->adler_b;
+    while (count > 0) {
+        size_t run = count < ADLER_RUN ? count : ADLER_RUN;
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        count -= run;
+    }
+    w->adler_a = a;
+    w->adler_b = b;
+}
+
+// raw zlib payload, cut into stored blocks; band_left is what the open chunk still has to carry
+static void stored_put(struct ImageWriter* w, const unsigned char* data, size_t count, size_t* band_left, bool last_band) {
+    adler_update(w, data, count);
+    while (count > 0) {
+        if (w->block_left == 0) {
+            int size = *band_left < STORED_BLOCK_MAX ? (int)*band_left : STORED_BLOCK_MAX;
+            bool final = last_band && (size_t)size == *band_left;
+            unsigned char header[5] = {final ? 1 : 0, (unsigned char)size, (unsigned char)(size >> 8), (unsigned char)~size,
+                                       (unsigned char)(~size >> 8)};
+            chunk_put(w, header, 5);
+            w->block_left = size;
+        }
+        size_t n = count < (size_t)w->block_left ? count : (size_t)w->block_left;
+        chunk_put(w, data, n);
+        data += n;
+        count -= n;
+        w->block_left -= (int)n;
+        *band_left -= n;
+    }
+}
+
+static void to_rgb(const Uint32* pixels, int width, unsigned char* out) {
+    for (int x = 0; x < width; x++) {
+        out[3 * x] = (unsigned char)(pixels[x] >> 16);
+        out[3 * x + 1] = (unsigned char)(pixels[x] >> 8);
+        out[3 * x + 2] = (unsigned char)pixels[x];
+    }
+}
+
+struct ImageWriter* image_open(const char* path, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "image: invalid size %dx%d\n", width, height);
+        return NULL;
+    }
+    if (!crc_ready) {
+        build_crc_table();
+    }
+
+    struct ImageWriter* w = calloc(1, sizeof(struct ImageWriter));
+    if (!w) {
+        fprintf(stderr, "image: allocation failed\n");
+        return NULL;
+    }
+    w->png = !ends_with_ppm(path);
+    w->width = width;
+    w->height = height;
+    w->adler_a = 1;
+    w->adler_b = 0;
+    w->row = malloc(1 + (size_t)width * 3);
+    w->file = fopen(path, "wb");
+    if (!w->row || !w->file) {
+        fprintf(stderr, "image: can't create %s\n", path);
+        if (w->file) {
+            fclose(w->file);
+        }
+        free(w->row);
+        free(w);
+        return NULL;
+    }
+
+    if (!w->png) {
+        fprintf(w->file, "P6\n%d %d\n255\n", width, height);
+        return w;
+    }
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, 8, w->file);
+
+    // 8 bit RGB, no interlacing
+    unsigned char ihdr[13] = {0};
+    put_be32(ihdr, (uint32_t)width);
+    put_be32(ihdr + 4, (uint32_t)height);
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    chunk_begin(w, "IHDR", 13);
+    chunk_put(w, ihdr, 13);
+    chunk_end(w);
+    return w;
+}
+
+int image_write_rows(struct ImageWriter* w, const Uint32* pixels, int rows) {
+    if (rows > w->height - w->rows_written) {
+        rows = w->height - w->rows_written;
+    }
+    if (rows <= 0) {
+        return 0;
+    }
+
+    if (!w->png) {
+        for (int r = 0; r < rows; r++) {
+            to_rgb(pixels + (size_t)r * w->width, w->width, w->row);
+            fwrite(w->row, 1, (size_t)w->width * 3, w->file);
+        }
+        w->rows_written += rows;
+        return ferror(w->file) ? 1 : 0;
+    }
+
+    // one IDAT chunk per band: zlib header on the first, adler-32 trailer on the last
+    size_t row_bytes = 1 + (size_t)w->width * 3;
+    size_t raw = row_bytes * rows;
+    size_t blocks = (raw + STORED_BLOCK_MAX - 1) / STORED_BLOCK_MAX;
+    bool first = w->rows_written == 0;
+    bool last = w->rows_written + rows == w->height;
+    size_t length = (first ? 2 : 0) + blocks * 5 + raw + (last ? 4 : 0);
+    if (length > 0x7FFFFFFF) {
+        fprintf(stderr, "image: band of %d rows is too large for one PNG chunk\n", rows);
+        return 1;
+    }
+
+    chunk_begin(w, "IDAT", (uint32_t)length);
+    if (first) {
+        static const unsigned char zlib_header[2] = {0x78, 0x01};
+        chunk_put(w, zlib_header, 2);
+    }
+    w->block_left = 0;
+    size_t band_left = raw;
+    for (int r = 0; r < rows; r++) {
+        w->row[0] = 0;  // no filter
+        to_rgb(pixels + (size_t)r * w->width, w->width, w->row + 1);
+        stored_put(w, w->row, row_bytes, &band_left, last);
+    }
+    if (last) {
+        unsigned char adler[4];
+        put_be32(adler, (w->adler_b << 16) | w->adler_a);
+        chunk_put(w, adler, 4);
+    }
+    chunk_end(w);
+
+    w->rows_written += rows;
+    return ferror(w->file) ? 1 : 0;
+}
+
+int image_close(struct ImageWriter* w) {
+    int status = 0;
+    if (w->rows_written < w->height) {
+        fprintf(stderr, "image: only %d of %d rows were written\n", w->rows_written, w->height);
+        status = 1;
+    }
+    if (w->png) {
+        chunk_begin(w, "IEND", 0);
+        chunk_end(w);
+    }
+    if (ferror(w->file)) {
+        fprintf(stderr, "image: write failed\n");
+        status = 1;
+    }
+    if (fclose(w->file) != 0) {
+        status = 1;
+    }
+    free(w->row);
+    free(w);
+    return status;
+}
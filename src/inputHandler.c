@@ -23,6 +23,13 @@ struct viewport* init_viewport(int width, int height) {
     vp->initial_offset_x = 0.01;
     vp->initial_offset_y = 0.0;
 
+    ap_from_double(&vp->centre_x, vp->current_offset_x);
+    ap_from_double(&vp->centre_y, vp->current_offset_y);
+    vp->offset_lo_x = 0.0;
+    vp->offset_lo_y = 0.0;
+    vp->initial_centre_x = vp->centre_x;
+    vp->initial_centre_y = vp->centre_y;
+
     vp->zoom = 0.0032;
 
     vp->iterations = 64;
@@ -31,6 +38,19 @@ struct viewport* init_viewport(int width, int height) {
     return vp;
 }
 
+void set_viewport_centre(struct viewport* vp, const struct apfloat* x, const struct apfloat* y) {
+    vp->centre_x = *x;
+    vp->centre_y = *y;
+    vp->current_offset_x = ap_to_double(x);
+    vp->current_offset_y = ap_to_double(y);
+
+    struct apfloat rest;
+    ap_add_double(&rest, x, -vp->current_offset_x);
+    vp->offset_lo_x = ap_to_double(&rest);
+    ap_add_double(&rest, y, -vp->current_offset_y);
+    vp->offset_lo_y = ap_to_double(&rest);
+}
+
 // zooms towards the mouse position by factor amount
 void ZoomOnMouse(struct viewport* vp, double zoom_factor) {
     float mx, my;
@@ -39,13 +59,18 @@ void ZoomOnMouse(struct viewport* vp, double zoom_factor) {
     double mouse_screen_x = (double)mx - (vp->screen_width * 0.5);
     double mouse_screen_y = (double)my - (vp->screen_height * 0.5);
 
-    double world_x = vp->current_offset_x + mouse_screen_x * vp->zoom;
-    double world_y = vp->current_offset_y + mouse_screen_y * vp->zoom;
+    double new_zoom = vp->zoom * zoom_factor;
+    if (new_zoom < MIN_ZOOM) {
+        new_zoom = MIN_ZOOM;  // reference orbits run out of precision past this
+    }
 
-    vp->zoom *= zoom_factor;
+    // keep the world point under the mouse fixed: centre += mouse * (old zoom - new zoom)
+    struct apfloat x, y;
+    ap_add_double(&x, &vp->centre_x, mouse_screen_x * (vp->zoom - new_zoom));
+    ap_add_double(&y, &vp->centre_y, mouse_screen_y * (vp->zoom - new_zoom));
+    vp->zoom = new_zoom;
 
-    vp->current_offset_x = world_x - mouse_screen_x * vp->zoom;
-    vp->current_offset_y = world_y - mouse_screen_y * vp->zoom;
+    set_viewport_centre(vp, &x, &y);
 }
 
 // true when screen redraw is required
@@ -62,6 +87,8 @@ bool handle_mouse_events(SDL_Event* event, struct viewport* vp) {
 
             vp->initial_offset_x = vp->current_offset_x;
             vp->initial_offset_y = vp->current_offset_y;
+            vp->initial_centre_x = vp->centre_x;
+            vp->initial_centre_y = vp->centre_y;
         }
         break;
     }
@@ -74,8 +101,10 @@ bool handle_mouse_events(SDL_Event* event, struct viewport* vp) {
             int dx = current_x - vp->drag_start_x;
             int dy = current_y - vp->drag_start_y;
 
-            vp->current_offset_x = vp->initial_offset_x - (double)dx * vp->zoom;
-            vp->current_offset_y = vp->initial_offset_y - (double)dy * vp->zoom;
+            struct apfloat x, y;
+            ap_add_double(&x, &vp->initial_centre_x, -(double)dx * vp->zoom);
+            ap_add_double(&y, &vp->initial_centre_y, -(double)dy * vp->zoom);
+            set_viewport_centre(vp, &x, &y);
 
             redraw_required = true;
         }
@@ -10,14 +10,17 @@
 #include "benchmark.h"
 #include "colour_palette.h"
 #include "core_count.h"
+#include "headless.h"
 #include "inputHandler.h"
 #include "mandelbrot.h"
 #include "render_context.h"
+#include "simd_handler.h"
+#include "thread_pool.h"
+#include "tiled_image.h"
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 #include <math.h>
-#include <pthread.h>
 
 #define SCRN_HEIGHT 720
 #define SCRN_WIDTH 1280
@@ -25,18 +28,12 @@
 #define TARGET_FPS 60
 #define TARGET_FRAME_TIME (1000 / TARGET_FPS)
 
-#define MAX_ITERATIONS 100000
+// samples averaged into each pixel while the view is idle before the viewer stops adding more
+#define ACCUM_MAX_SAMPLES 64
 
-void cleanup(struct RenderContext* rc, struct ThreadPool* tp, struct viewport* vp) {
-    if (tp != NULL) {
-        for (int i = 0; i < tp->count; i++) {
-            free(tp->jobs[i].iteration_out);
-        }
-    }
-
-    free(tp->jobs);
-    free(tp->threads);
+void cleanup(struct RenderContext* rc, struct viewport* vp) {
     free(rc->buffer);
+    free(rc->accum);
     free(vp);
 
     SDL_DestroyTexture(rc->texture);
@@ -45,47 +42,49 @@ void cleanup(struct RenderContext* rc, struct ThreadPool* tp, struct viewport* v
     SDL_Quit();
 }
 
-int calculateIterations(double zoom) {
-    if (zoom <= 0.0)
-        return 5000;
+// the viewer's settings for a frame of vp
+void initFrame(struct RenderJob* frame, struct RenderContext* rc, struct PaletteState* ps, struct viewport* vp) {
+    *frame = (struct RenderJob){0};
+    frame->scrn_width = SCRN_WIDTH;
+    frame->vp = vp;
+    frame->palette = ps->generated;
+    frame->palette_size = PALETTE_SIZE;
+    frame->palette_version = ps->index;  // generated holds the palette at index, rewritten in place by M
+    frame->buffer = rc->buffer;
+    frame->start_render_frac = 8;
+    frame->render_smooth = ps->smooth;
+    frame->use_simd = true;
+    frame->precision = select_precision(vp);
+    frame->mariani_silver = rc->mariani_silver;
+    frame->solid_guess = rc->solid_guess;
+    frame->aa_samples = rc->aa_samples;
+}
 
-    double magnification = 1.0 / zoom;
+// recolour asks the pool to reuse the last frame's iteration counts when the view hasn't changed
+void drawBuffer(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteState* ps, struct viewport* vp, bool recolour) {
+    // begin new render, the pool cancels whatever frame is still in flight, accumulation included
+    SDL_RenderClear(rc->renderer);
+    rc->accum_samples = 0;
 
-    // "100 per decade" heuristic
-    int iter = 40 + (100 * log10(magnification));
+    struct RenderJob frame;
+    initFrame(&frame, rc, ps, vp);
+    frame.recolour = recolour;
 
-    if (iter < 32) {
-        return 32;
-    }
-    iter = iter > MAX_ITERATIONS ? MAX_ITERATIONS : iter;
-    return iter;
+    thread_pool_render(tp, &frame);
 }
 
-void drawBuffer(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteState* ps) {
-    // rejoin existing threads
-    if (tp->threads != NULL) {
-        tp->kill = true;
+// one more jittered sample of every pixel of the finished frame, averaged in; any input posts a new frame, which
+// cancels it within a row of each tile
+void accumulateBuffer(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteState* ps, struct viewport* vp) {
+    struct RenderJob frame;
+    initFrame(&frame, rc, ps, vp);
+    frame.accum = rc->accum;
+    frame.accum_sample = ++rc->accum_samples;
 
-        for (int i = 0; i < tp->count; i++) {
-            pthread_join(tp->threads[i], NULL);
-        }
-
-        tp->kill = false;
-    }
-
-    // begin new render
-    SDL_RenderClear(rc->renderer);
-
-    for (int i = 0; i < tp->count; i++) {
-        tp->jobs[i].start_render_frac = 8;
-        tp->jobs[i].render_smooth = ps->smooth;
-        tp->jobs[i].palette = ps->generated;
-        tp->jobs[i].use_simd = true;
-        pthread_create(&tp->threads[i], NULL, calculateMandelbrotRoutine, &tp->jobs[i]);
-    }
+    thread_pool_render(tp, &frame);
 }
 
-int init_app(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteState* ps, struct viewport** vp_out, int arg_thread_num) {
+int init_app(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteState* ps, struct viewport** vp_out, int arg_thread_num, int tile_size) {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         fprintf(stderr, "Failed to initialise SDL\n");
         return 1;
@@ -108,11 +107,13 @@ int init_app(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteStat
     }
     rc->texture = SDL_CreateTexture(rc->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCRN_WIDTH, SCRN_HEIGHT);
     rc->buffer = malloc(sizeof(Uint32) * SCRN_HEIGHT * SCRN_WIDTH);
+    rc->accum = malloc(sizeof(unsigned int) * 4 * SCRN_HEIGHT * SCRN_WIDTH);
 
-    if (!rc->texture || !rc->buffer) {
+    if (!rc->texture || !rc->buffer || !rc->accum) {
         fprintf(stderr, "Failed to initialise SDL resources\n");
         // vp not yet allocated
         free(rc->buffer);
+        free(rc->accum);
         SDL_DestroyTexture(rc->texture);
         SDL_DestroyRenderer(rc->renderer);
         SDL_DestroyWindow(rc->window);
@@ -121,33 +122,19 @@ int init_app(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteStat
     }
 
     struct viewport* vp = init_viewport(SCRN_WIDTH, SCRN_HEIGHT);
-
-    // allow --threads arg to override
-    tp->count = arg_thread_num == 0 ? get_num_logical_cores() : arg_thread_num;
-    tp->threads = calloc(tp->count, sizeof(pthread_t));
-
-    if (!vp || !tp->threads) {
+    if (!vp) {
         fprintf(stderr, "Failed to allocate memory\n");
-        cleanup(rc, tp, vp);
+        cleanup(rc, vp);
         return 1;
     }
 
-    tp->jobs = calloc(tp->count, sizeof(struct RenderJob));
-    if (!tp->jobs) {
-        fprintf(stderr, "Failed to allocate render data\n");
-        cleanup(rc, tp, vp);
+    // allow --threads arg to override
+    long thread_count = arg_thread_num == 0 ? get_num_logical_cores() : arg_thread_num;
+    if (thread_pool_init(tp, thread_count, SCRN_WIDTH, SCRN_HEIGHT, tile_size) != 0) {
+        cleanup(rc, vp);
         return 1;
     }
 
-    for (int i = 0; i < tp->count; i++) {
-        tp->jobs[i].iteration_out = malloc(SCRN_WIDTH * sizeof(int));
-        if (!tp->jobs[i].iteration_out) {
-            fprintf(stderr, "Failed to allocate iter_scratch\n");
-            cleanup(rc, tp, vp);
-            return 1;
-        }
-    }
-
     // palette
     ps->index = 0;
     ps->smooth = true;
@@ -155,24 +142,8 @@ int init_app(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteStat
     generateColourPalette(ps->current, 8, ps->generated, PALETTE_SIZE);
 
     // render options
-    tp->kill = false;
     vp->iterations = calculateIterations(vp->zoom) * vp->iteration_multiplier;
 
-    // distribute rows across threads
-    int rows_per_thread = SCRN_HEIGHT / tp->count;
-    for (int i = 0; i < tp->count; i++) {
-        tp->jobs[i].start_y = i * rows_per_thread;
-        tp->jobs[i].end_y = (i == tp->count - 1) ? SCRN_HEIGHT : (i + 1) * rows_per_thread;
-        tp->jobs[i].scrn_width = SCRN_WIDTH;
-        tp->jobs[i].vp = vp;
-        tp->jobs[i].palette = ps->generated;
-        tp->jobs[i].palette_size = PALETTE_SIZE;
-        tp->jobs[i].render_smooth = ps->smooth;
-        tp->jobs[i].buffer = rc->buffer;
-        tp->jobs[i].kill_signal = &tp->kill;
-        tp->jobs[i].start_render_frac = 8;
-    }
-
     *vp_out = vp;
     return 0;
 }
@@ -181,6 +152,7 @@ int init_app(struct RenderContext* rc, struct ThreadPool* tp, struct PaletteStat
 bool process_events(struct ThreadPool* tp, struct PaletteState* ps, struct viewport* vp, struct RenderContext* rc) {
     SDL_Event event;
     bool redraw = false;
+    bool recolour = false;  // palette or shading only, no new iteration counts needed
 
     while (SDL_PollEvent(&event)) {
         if (event.type == SDL_EVENT_QUIT) {
@@ -188,6 +160,7 @@ bool process_events(struct ThreadPool* tp, struct PaletteState* ps, struct viewp
         }
 
         if (event.type == SDL_EVENT_KEY_DOWN) {
+            bool colours_only = false;
             switch (event.key.key) {
             // use < and > to change max_iterations
             case SDLK_PERIOD:
@@ -203,12 +176,14 @@ bool process_events(struct ThreadPool* tp, struct PaletteState* ps, struct viewp
             // use / to toggle smooth (cyclic) shading
             case SDLK_SLASH:
                 ps->smooth = !ps->smooth;
+                colours_only = true;
                 break;
 
             // use M to change colour palette
             case SDLK_M:
                 ps->current = cyclePalettes(&ps->index);
                 generateColourPalette(ps->current, 8, ps->generated, PALETTE_SIZE);
+                colours_only = true;
                 break;
 
             case SDLK_RETURN:
@@ -224,7 +199,11 @@ bool process_events(struct ThreadPool* tp, struct PaletteState* ps, struct viewp
             default:
                 break;
             }
-            redraw = true;
+            if (colours_only) {
+                recolour = true;
+            } else {
+                redraw = true;
+            }
         }
 
         if (handle_mouse_events(&event, vp)) {
@@ -235,7 +214,9 @@ bool process_events(struct ThreadPool* tp, struct PaletteState* ps, struct viewp
     if (redraw) {
         int it = (int)(calculateIterations(vp->zoom) * vp->iteration_multiplier);
         vp->iterations = (it < 1) ? 1 : it;
-        drawBuffer(rc, tp, ps);
+        drawBuffer(rc, tp, ps, vp, false);
+    } else if (recolour) {
+        drawBuffer(rc, tp, ps, vp, true);
     }
 
     return true;
@@ -243,19 +224,20 @@ bool process_events(struct ThreadPool* tp, struct PaletteState* ps, struct viewp
 
 void shutdown_app(struct RenderContext* rc, struct ThreadPool* tp, struct viewport* vp) {
     // stop all render threads before freeing shared resources
-    tp->kill = true;
-    for (int i = 0; i < tp->count; i++) {
-        pthread_join(tp->threads[i], NULL);
-    }
-    cleanup(rc, tp, vp);
+    thread_pool_destroy(tp);
+    cleanup(rc, vp);
 }
 
 int main(int argc, char* argv[]) {
-    // check for benchmark call
-    struct BenchmarkOpts bench_opts = {.threads = 0, .smooth = false, .scalar = false, .sweep = false, .no_optimisations = false};
+    // check for benchmark call, options not named below start at zero, false or NULL
+    struct BenchmarkOpts bench_opts = {.tile_size = DEFAULT_TILE_SIZE, .precision = -1, .repeats = 1, .threshold = 0.05};
     bool do_benchmark = false;
     int thread_count_override = 0;
 
+    // headless still, framed like the viewer's opening view unless told otherwise
+    struct HeadlessOpts render_opts = {.width = SCRN_WIDTH, .height = SCRN_HEIGHT, .centre_x = "-0.72", .centre_y = "0.0", .frames = 100};
+    bool poster = false;
+
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--benchmark") == 0) {
             do_benchmark = true;
@@ -267,20 +249,152 @@ int main(int argc, char* argv[]) {
             bench_opts.scalar = true;
         } else if (strcmp(argv[i], "--sweep") == 0) {
             bench_opts.sweep = true;
+        } else if (strcmp(argv[i], "--kernels") == 0) {
+            // benchmark the double SIMD kernel alone on every target this CPU can run, or only the --simd-target one
+            bench_opts.kernels = true;
+        } else if (strcmp(argv[i], "--simd-target") == 0 && i + 1 < argc) {
+            // viewer, benchmark and headless renders: dispatch to this target instead of the best
+            const char* target = argv[++i];
+            if (!mandelbrot_simd_set_target(target)) {
+                const char* names[32];
+                int count = mandelbrot_simd_targets(names, 32);
+                fprintf(stderr, "--simd-target: %s isn't a target this build and CPU can run, choose from:", target);
+                for (int t = 0; t < count && t < 32; t++) {
+                    fprintf(stderr, " %s", names[t]);
+                }
+                fprintf(stderr, "\n");
+                return 1;
+            }
+            bench_opts.simd_target = target;
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            // float, double, dd or perturb for every scene instead of choosing per frame
+            i++;
+            if (strcmp(argv[i], "float") == 0) {
+                bench_opts.precision = PRECISION_FLOAT;
+            } else if (strcmp(argv[i], "double") == 0) {
+                bench_opts.precision = PRECISION_DOUBLE;
+            } else if (strcmp(argv[i], "dd") == 0) {
+                bench_opts.precision = PRECISION_DOUBLE_DOUBLE;
+            } else if (strcmp(argv[i], "perturb") == 0) {
+                bench_opts.precision = PRECISION_PERTURBATION;
+            } else {
+                fprintf(stderr, "--precision: %s isn't a precision, choose from: float double dd perturb\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--deep") == 0) {
+            bench_opts.deep = true;
+        } else if (strcmp(argv[i], "--mid") == 0) {
+            bench_opts.mid = true;
+        } else if (strcmp(argv[i], "--mariani-silver") == 0) {
+            // viewer and benchmark
+            bench_opts.mariani_silver = true;
+        } else if (strcmp(argv[i], "--solid-guess") == 0) {
+            // viewer and benchmark, only the passes after the first guess
+            bench_opts.solid_guess = true;
+        } else if (strcmp(argv[i], "--aa") == 0 && i + 1 < argc) {
+            // viewer, benchmark and headless renders: up to N jittered subsamples for each edge pixel
+            int samples = atoi(argv[++i]);
+            bench_opts.aa_samples = samples < 0 ? 0 : samples > AA_MAX_SAMPLES ? AA_MAX_SAMPLES : samples;
+        } else if (strcmp(argv[i], "--aa-budget") == 0 && i + 1 < argc) {
+            // benchmark and headless renders: extra samples per frame, the default allows one per pixel
+            bench_opts.aa_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            // benchmark: untimed runs of each scene first
+            bench_opts.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            // benchmark: timed runs of each scene, reported by their median with min, p95 and stddev
+            bench_opts.repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+            // benchmark: timings and run settings as .csv, or JSON for any other name
+            bench_opts.report = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            // benchmark: keep every scene's runs to compare later builds against
+            bench_opts.save_baseline = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            // benchmark: exit 1 when a scene is significantly slower than in the baseline
+            bench_opts.compare = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            // benchmark: percent slower that counts as a regression, 5 by default
+            bench_opts.threshold = atof(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "--progressive") == 0) {
+            // benchmark 8 -> 1 passes like the viewer instead of a single full resolution pass
+            bench_opts.progressive = true;
         } else if (strcmp(argv[i], "--nooptimisation") == 0) {
             bench_opts.no_optimisations = true;
         } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
             bench_opts.threads = atoi(argv[++i]);
             thread_count_override = bench_opts.threads;
+        } else if (strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc) {
+            // 0 falls back to one static band per thread
+            bench_opts.tile_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            // headless still to a .png or .ppm file, see headless.h
+            render_opts.output = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &render_opts.width, &render_opts.height) != 2) {
+                fprintf(stderr, "--size expects WIDTHxHEIGHT\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--centre") == 0 && i + 2 < argc) {
+            render_opts.centre_x = argv[++i];
+            render_opts.centre_y = argv[++i];
+        } else if (strcmp(argv[i], "--zoom") == 0 && i + 1 < argc) {
+            // world units per output pixel
+            render_opts.zoom = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            render_opts.iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc) {
+            render_opts.palette = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--band-rows") == 0 && i + 1 < argc) {
+            render_opts.band_rows = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--poster") == 0 && i + 1 < argc) {
+            // headless still into a resumable memory-mapped tiled file, see tiled_image.h
+            render_opts.output = argv[++i];
+            poster = true;
+        } else if (strcmp(argv[i], "--poster-tile") == 0 && i + 1 < argc) {
+            render_opts.poster_tile = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--animate") == 0 && i + 1 < argc) {
+            // frames along a keyframe file to the --render pattern, see run_animation()
+            render_opts.keyframes = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            render_opts.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--export-poster") == 0 && i + 2 < argc) {
+            // finished tiled file to .png or .ppm
+            const char* tiles = argv[++i];
+            return tiled_export(tiles, argv[++i]);
+        }
+    }
+
+    if (render_opts.output) {
+        render_opts.smooth = bench_opts.smooth;
+        render_opts.threads = bench_opts.threads;
+        render_opts.tile_size = bench_opts.tile_size;
+        render_opts.precision = bench_opts.precision;
+        render_opts.mariani_silver = bench_opts.mariani_silver;
+        render_opts.aa_samples = bench_opts.aa_samples;
+        render_opts.aa_budget = bench_opts.aa_budget;
+        if (render_opts.keyframes) {
+            return run_animation(render_opts);
+        }
+
+        if (render_opts.zoom <= 0.0 && render_opts.width > 0) {
+            render_opts.zoom = 0.0032 * SCRN_WIDTH / render_opts.width;
+        }
+        if (render_opts.iterations <= 0) {
+            render_opts.iterations = calculateIterations(render_opts.zoom);
         }
+        return poster ? run_poster(render_opts) : run_headless(render_opts);
     }
 
     if (do_benchmark) {
-        if (bench_opts.sweep)
+        if (bench_opts.sweep) {
             run_sweep(bench_opts);
-        else
-            run_benchmark(bench_opts);
-        return 0;
+            return 0;
+        }
+        if (bench_opts.kernels) {
+            return run_kernel_bench(bench_opts);
+        }
+        return run_benchmark(bench_opts);
     }
 
     printf(
@@ -294,12 +408,15 @@ int main(int argc, char* argv[]) {
     struct ThreadPool tp = {0};
     struct PaletteState ps = {0};
     struct viewport* vp = NULL;
+    rc.mariani_silver = bench_opts.mariani_silver;
+    rc.solid_guess = bench_opts.solid_guess;
+    rc.aa_samples = bench_opts.aa_samples;
 
-    if (init_app(&rc, &tp, &ps, &vp, thread_count_override) != 0) {
+    if (init_app(&rc, &tp, &ps, &vp, thread_count_override, bench_opts.tile_size) != 0) {
         return 1;
     }
 
-    drawBuffer(&rc, &tp, &ps);
+    drawBuffer(&rc, &tp, &ps, vp, false);
 
     while (true) {
         Uint64 frameStart = SDL_GetTicks();
@@ -308,8 +425,18 @@ int main(int argc, char* argv[]) {
             break;
         }
 
-        // transfer buffer in RAM to VRAM
-        SDL_UpdateTexture(rc.texture, NULL, rc.buffer, sizeof(Uint32) * SCRN_WIDTH);
+        // spend idle time refining the still view
+        bool idle = thread_pool_finished(&tp);
+        if (idle && rc.accum_samples < ACCUM_MAX_SAMPLES) {
+            accumulateBuffer(&rc, &tp, &ps, vp);
+            idle = false;
+        }
+
+        // transfer buffer in RAM to VRAM, once more after the pool goes idle and then not until it changes
+        if (!idle || !rc.texture_current) {
+            SDL_UpdateTexture(rc.texture, NULL, rc.buffer, sizeof(Uint32) * SCRN_WIDTH);
+            rc.texture_current = idle;
+        }
 
         // draw VRAM
         SDL_RenderTexture(rc.renderer, rc.texture, NULL, NULL);
@@ -1,12 +1,33 @@
 #include "mandelbrot.h"
 #include "inputHandler.h"
+#include "perturbation.h"
 #include "simd_handler.h"
 
+#include <float.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define MAX_ITERATIONS 100000
+
+int calculateIterations(double zoom) {
+    if (zoom <= 0.0)
+        return 5000;
+
+    double magnification = 1.0 / zoom;
+
+    // "100 per decade" heuristic
+    int iter = 40 + (100 * log10(magnification));
+
+    if (iter < 32) {
+        return 32;
+    }
+    iter = iter > MAX_ITERATIONS ? MAX_ITERATIONS : iter;
+    return iter;
+}
+
 static inline int isKnownInside(double x0, double y0) {
     // test 1. If x0, y0 is within distance of 1/4 from point (-1,0)
     // it is guaranteed to be inside
@@ -33,25 +54,45 @@ int calculateMandelbrot(double x0, double y0, int max_iterations) {
 }
 
 int calculateMandelbrotOpts(double x0, double y0, int max_iterations, bool no_optimisations) {
-    if (!no_optimisations && isKnownInside(x0, y0))
+    return continueMandelbrot(x0, y0, max_iterations, no_optimisations, NULL, NULL);
+}
+
+// orbit (may be NULL) holds the state to carry on from, and receives the final state when the point doesn't escape
+// counts (may be NULL) has the work done added to it
+int continueMandelbrot(double x0, double y0, int max_iterations, bool no_optimisations, struct OrbitState* orbit,
+                       struct IterationCounts* counts) {
+    if (!no_optimisations && isKnownInside(x0, y0)) {
+        if (orbit) {
+            orbit->iterations = 0;  // inside at any limit
+        }
+        if (counts) {
+            counts->inside++;
+        }
         return max_iterations;
+    }
 
-    double x = 0.0;
-    double y = 0.0;
+    double x = orbit ? orbit->x : 0.0;
+    double y = orbit ? orbit->y : 0.0;
 
-    double oldx = 0.0;
-    double oldy = 0.0;
+    double oldx = orbit ? orbit->oldx : 0.0;
+    double oldy = orbit ? orbit->oldy : 0.0;
 
     double epsilon2 = 1e-24;
     const int checkInterval = 20;
     int checkcountdown = checkInterval;
 
-    for (int i = 0; i < max_iterations; i++) {
+    int start = orbit ? orbit->iterations : 0;
+    int i = start;
+    for (; i < max_iterations; i++) {
         double x2 = x * x;
         double y2 = y * y;
 
         // escape check
         if (x2 + y2 > 4.0) {
+            if (counts) {
+                counts->iterations += i - start;
+                counts->lane_steps += i - start;
+            }
             return i;  // Return the escape iteration count
         }
 
@@ -68,7 +109,12 @@ int calculateMandelbrotOpts(double x0, double y0, int max_iterations, bool no_op
 
             // scale epsilon by point magnitude
             if (dx * dx + dy * dy < epsilon2 * (x2 + y2 + 1.0)) {
-                return max_iterations;  // inside set
+                if (counts) {
+                    counts->iterations++;  // the step just taken
+                    counts->lane_steps++;
+                    counts->periodic++;
+                }
+                break;  // inside set
             }
             oldx = x;
             oldy = y;
@@ -77,9 +123,59 @@ int calculateMandelbrotOpts(double x0, double y0, int max_iterations, bool no_op
         }
     }
 
+    if (counts) {
+        counts->iterations += i - start;
+        counts->lane_steps += i - start;
+    }
+    if (orbit) {
+        orbit->cx = x0;
+        orbit->x = x;
+        orbit->y = y;
+        orbit->oldx = oldx;
+        orbit->oldy = oldy;
+        orbit->iterations = i;  // below the limit when the periodicity check ended it
+    }
     return max_iterations;
 }
 
+// float32 is used while neighbouring pixels are at least this many float ulps apart; c then moves by
+// under 1/512 of a pixel, which changes the image no more than sampling at a sub-pixel offset
+#define FLOAT_PIXEL_ULPS 512.0
+
+// below this pixel size (relative to the centre's magnitude) plain doubles turn blocky
+#define DOUBLE_MIN_ZOOM 1e-11
+
+enum Precision select_precision(const struct viewport* vp) {
+    // largest coordinate on screen sets the rounding step
+    double half_w = 0.5 * vp->screen_width * vp->zoom;
+    double half_h = 0.5 * vp->screen_height * vp->zoom;
+    double scale = fmax(1.0, fmax(fabs(vp->current_offset_x) + half_w, fabs(vp->current_offset_y) + half_h));
+
+    if (vp->zoom >= FLOAT_PIXEL_ULPS * FLT_EPSILON * scale) {
+        return PRECISION_FLOAT;
+    }
+    if (vp->zoom >= DOUBLE_MIN_ZOOM * scale) {
+        return PRECISION_DOUBLE;
+    }
+    if (vp->zoom >= PERTURBATION_ZOOM * scale) {
+        return PRECISION_DOUBLE_DOUBLE;
+    }
+    return PRECISION_PERTURBATION;
+}
+
+const char* precision_name(enum Precision precision) {
+    switch (precision) {
+    case PRECISION_FLOAT:
+        return "float";
+    case PRECISION_DOUBLE_DOUBLE:
+        return "dd";
+    case PRECISION_PERTURBATION:
+        return "perturb";
+    default:
+        return "double";
+    }
+}
+
 // assume min is 0 for both inputs
 int fast_map_range(int value, int in_max, int out_max) {
     value = value >= in_max ? 0 : value;  // clamp max
@@ -110,94 +206,855 @@ static inline Uint32 cyclicPalette(struct RenderJob* data, int iterations, int p
     return colour;
 }
 
+// map iterations to colour data
+static inline Uint32 iterationColour(struct RenderJob* data, int iterations, double palette_scale) {
+    return data->render_smooth
+               ? cyclicPalette(data, iterations, palette_scale)
+               : data->palette[fast_map_range(iterations, data->vp->iterations, data->palette_size - 1)];
+}
+
+// colours for count iteration counts; the vector version is the same mapping
+static void colourSpan(struct RenderJob* data, const int* iterations, int count, double palette_scale, Uint32* out) {
+    if (data->use_simd) {
+        mandelbrot_simd_colour_row(iterations, count, data->vp->iterations, data->palette, data->palette_size, data->render_smooth,
+                                   (int)palette_scale, out);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        out[i] = iterationColour(data, iterations[i], palette_scale);
+    }
+}
+
+// log2 of a power of two, -1 for anything else
+static int powerOfTwoShift(int value) {
+    if (value <= 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    int shift = 0;
+    while ((1 << shift) < value) {
+        shift++;
+    }
+    return shift;
+}
+
+// iterations of pixels (x + i * step, y) relative to the reference orbit
+// records which of them the reference could not resolve; every pixel is a sample of exactly one pass
+static void perturbSpan(struct RenderJob* data, int x, int y, int step, int count, int* out) {
+    struct Perturbation* p = data->perturb;
+    const double zoom = data->vp->zoom;
+
+    for (int i = 0; i < count; i++) {
+        data->delta_out[i] = (double)(x + i * step - p->orbit.ref_x) * zoom;
+    }
+    double dcy = (double)(y - p->orbit.ref_y) * zoom;
+    perturbation_row(data, data->delta_out, dcy, count, out, data->glitch_out);
+
+    unsigned char* flags = p->glitched + (size_t)y * p->width + x;
+    for (int i = 0; i < count; i++) {
+        flags[i * step] = data->glitch_out[i];
+    }
+}
+
+// pixels of the tile still flagged once it has reached full resolution
+static void countGlitches(struct RenderJob* data) {
+    struct Perturbation* p = data->perturb;
+    for (int y = data->start_y; y < data->end_y; y++) {
+        const unsigned char* flags = p->glitched + (size_t)y * p->width;
+        for (int x = data->start_x; x < data->end_x; x++) {
+            data->glitched_pixels += flags[x];
+        }
+    }
+}
+
+// iteration counts of pixels (x + i * step, y) for i < count, in the frame's precision
+// orbits a span starts from: the saved ones in a RESUME_PASS, z = 0 at c = x0 + i * zoom_step otherwise
+// a step of the screen width walks down a column instead, with a zoom_step of 0
+static void loadOrbits(struct RenderJob* data, int x, int y, int step, int count, double x0, double zoom_step, struct OrbitState* orbit) {
+    const struct OrbitStore* store = data->orbits;
+    const int* slot = store->slot + (size_t)y * data->vp->screen_width;
+    for (int i = 0; i < count; i++) {
+        int index = data->resume_limit > 0 ? slot[x + i * step] : ORBIT_NONE;
+        if (index >= 0) {
+            orbit[i] = store->states[index];
+        } else {
+            orbit[i] = (struct OrbitState){.cx = x0 + i * zoom_step};
+        }
+    }
+}
+
+// keep the orbits of the span's pixels that reached the limit, in place when a pixel already has one
+static void saveOrbits(struct RenderJob* data, int x, int y, int step, int count, const int* out, const struct OrbitState* orbit) {
+    struct OrbitStore* store = data->orbits;
+    int* slot = store->slot + (size_t)y * data->vp->screen_width;
+    for (int i = 0; i < count; i++) {
+        int* index = &slot[x + i * step];
+        if (out[i] < data->vp->iterations) {
+            *index = ORBIT_NONE;
+            continue;
+        }
+        if (orbit[i].iterations < data->vp->iterations) {
+            *index = ORBIT_INSIDE;
+            continue;
+        }
+        if (*index < 0) {
+            int next = store->used++;
+            if (next >= store->capacity) {
+                store->dropped++;
+                *index = ORBIT_NONE;
+                continue;
+            }
+            *index = next;
+        }
+        store->states[*index] = orbit[i];
+    }
+}
+
+static void computeSpan(struct RenderJob* data, int x, int y, int step, int count, int* out) {
+    const struct viewport* vp = data->vp;
+    const double zoom = vp->zoom;  // DISTANCE BETWEEN PIXELS IN WORLD SPACE
+    int halfWidth = vp->screen_width / 2;
+    int halfHeight = vp->screen_height / 2;
+
+    // worldspace coordinates
+    double x0 = vp->current_offset_x + (double)(x - halfWidth) * zoom;
+    double y0 = vp->current_offset_y + (double)(y - halfHeight) * zoom;
+    double zoom_step = zoom * step;
+
+    data->pixels_computed += count;
+
+    // double-double only exists as a vector kernel; single pixels skip the vector setup for the others
+    if (data->perturb) {
+        perturbSpan(data, x, y, step, count, out);
+    } else if (data->precision == PRECISION_DOUBLE_DOUBLE) {
+        mandelbrot_simd_row_dd(vp->current_offset_x, vp->offset_lo_x, (double)(x - halfWidth) * zoom, vp->current_offset_y, vp->offset_lo_y,
+                               (double)(y - halfHeight) * zoom, zoom_step, vp->iterations, out, count, data->no_optimisations,
+                               &data->counts);
+    } else {
+        // floats and plain doubles keep the orbits of the pixels left at the limit, so raising it can carry them on. an
+        // orbit has to be carried on by the arithmetic that started it, so single pixels of a vector kernel's tier take it too
+        struct OrbitState* orbit = data->orbits ? data->orbit_out : NULL;
+        const struct OrbitState* resume = orbit && data->resume_limit > 0 ? orbit : NULL;
+        if (orbit && (resume || !data->use_simd)) {
+            loadOrbits(data, x, y, step, count, x0, zoom_step, orbit);  // the vector kernels start from z = 0 themselves
+        }
+        if (!data->use_simd || (count == 1 && !orbit)) {
+            for (int i = 0; i < count; i++) {
+                double cx = orbit ? orbit[i].cx : x0 + i * zoom_step;
+                out[i] = continueMandelbrot(cx, y0, vp->iterations, data->no_optimisations, orbit ? &orbit[i] : NULL, &data->counts);
+            }
+        } else if (data->precision == PRECISION_FLOAT) {
+            mandelbrot_simd_row_f32(x0, y0, zoom_step, vp->iterations, out, count, data->no_optimisations, resume, orbit, &data->counts);
+        } else {
+            mandelbrot_simd_row(x0, y0, zoom_step, vp->iterations, out, count, data->no_optimisations, resume, orbit, &data->counts);
+        }
+        if (orbit) {
+            saveOrbits(data, x, y, step, count, out, orbit);
+        }
+    }
+}
+
+// iteration counts of pixels (x, y + i) for i < count, each in the arithmetic its own row's span would use, so
+// a column of a Mariani-Silver border runs through the vector kernels in one span like a row does
+static void computeColumn(struct RenderJob* data, int x, int y, int count) {
+    const struct viewport* vp = data->vp;
+    const double zoom = vp->zoom;
+    const int width = vp->screen_width;
+    int halfWidth = width / 2;
+    int halfHeight = vp->screen_height / 2;
+    int* out = data->iteration_out;
+
+    double x0 = vp->current_offset_x + (double)(x - halfWidth) * zoom;
+
+    data->pixels_computed += count;
+
+    if (data->perturb) {
+        struct Perturbation* p = data->perturb;
+        for (int i = 0; i < count; i++) {
+            data->delta_out[i] = (double)(y + i - p->orbit.ref_y) * zoom;
+        }
+        perturbation_column(data, (double)(x - p->orbit.ref_x) * zoom, data->delta_out, count, out, data->glitch_out);
+
+        unsigned char* flags = p->glitched + (size_t)y * p->width + x;
+        for (int i = 0; i < count; i++) {
+            flags[(size_t)i * p->width] = data->glitch_out[i];
+        }
+    } else if (data->precision == PRECISION_DOUBLE_DOUBLE) {
+        mandelbrot_simd_column_dd(vp->current_offset_x, vp->offset_lo_x, (double)(x - halfWidth) * zoom, vp->current_offset_y, vp->offset_lo_y,
+                                  y - halfHeight, zoom, vp->iterations, out, count, data->no_optimisations, &data->counts);
+    } else {
+        // orbits as computeSpan keeps them, see there
+        struct OrbitState* orbit = data->orbits ? data->orbit_out : NULL;
+        const struct OrbitState* resume = orbit && data->resume_limit > 0 ? orbit : NULL;
+        if (orbit && (resume || !data->use_simd)) {
+            loadOrbits(data, x, y, width, count, x0, 0.0, orbit);
+        }
+        if (!data->use_simd || (count == 1 && !orbit)) {
+            for (int i = 0; i < count; i++) {
+                double y0 = vp->current_offset_y + (double)(y + i - halfHeight) * zoom;
+                out[i] = continueMandelbrot(orbit ? orbit[i].cx : x0, y0, vp->iterations, data->no_optimisations, orbit ? &orbit[i] : NULL,
+                                            &data->counts);
+            }
+        } else if (data->precision == PRECISION_FLOAT) {
+            mandelbrot_simd_column_f32(x0, vp->current_offset_y, y - halfHeight, zoom, vp->iterations, out, count, data->no_optimisations,
+                                       resume, orbit, &data->counts);
+        } else {
+            mandelbrot_simd_column(x0, vp->current_offset_y, y - halfHeight, zoom, vp->iterations, out, count, data->no_optimisations,
+                                   resume, orbit, &data->counts);
+        }
+        if (orbit) {
+            saveOrbits(data, x, y, width, count, out, orbit);
+        }
+    }
+
+    int* cells = data->iterations + (size_t)y * width + x;
+    for (int i = 0; i < count; i++) {
+        cells[(size_t)i * width] = out[i];
+    }
+}
+
+// iteration counts of points (x + i + dx, y + dy) for i < count, in the frame's precision; nothing is saved
+// for them, and under perturbation glitch_out flags the ones the reference couldn't resolve
+static void subsampleSpan(struct RenderJob* data, int x, int y, double dx, double dy, int count, int* out) {
+    const struct viewport* vp = data->vp;
+    const double zoom = vp->zoom;
+    double x_offset = ((double)(x - vp->screen_width / 2) + dx) * zoom;
+    double y_offset = ((double)(y - vp->screen_height / 2) + dy) * zoom;
+
+    if (data->perturb) {
+        const struct ReferenceOrbit* ref = &data->perturb->orbit;
+        for (int i = 0; i < count; i++) {
+            data->delta_out[i] = ((double)(x + i - ref->ref_x) + dx) * zoom;
+        }
+        perturbation_row(data, data->delta_out, ((double)(y - ref->ref_y) + dy) * zoom, count, out, data->glitch_out);
+        return;
+    }
+
+    memset(data->glitch_out, 0, (size_t)count);
+    if (data->precision == PRECISION_DOUBLE_DOUBLE) {
+        mandelbrot_simd_row_dd(vp->current_offset_x, vp->offset_lo_x, x_offset, vp->current_offset_y, vp->offset_lo_y, y_offset, zoom,
+                               vp->iterations, out, count, data->no_optimisations, &data->counts);
+    } else if (!data->use_simd) {
+        for (int i = 0; i < count; i++) {
+            out[i] = continueMandelbrot(vp->current_offset_x + x_offset + i * zoom, vp->current_offset_y + y_offset, vp->iterations,
+                                        data->no_optimisations, NULL, &data->counts);
+        }
+    } else if (data->precision == PRECISION_FLOAT) {
+        mandelbrot_simd_row_f32(vp->current_offset_x + x_offset, vp->current_offset_y + y_offset, zoom, vp->iterations, out, count,
+                                data->no_optimisations, NULL, NULL, &data->counts);
+    } else {
+        mandelbrot_simd_row(vp->current_offset_x + x_offset, vp->current_offset_y + y_offset, zoom, vp->iterations, out, count,
+                            data->no_optimisations, NULL, NULL, &data->counts);
+    }
+}
+
+// re-render the pixels flagged by an earlier reference against the current one
+static void fixGlitches(struct RenderJob* data, double palette_scale) {
+    struct Perturbation* p = data->perturb;
+    const double zoom = data->vp->zoom;
+
+    for (int y = data->start_y; y < data->end_y; y++) {
+        if (*(data->generation_signal) != data->generation) {
+            return;
+        }
+
+        unsigned char* flags = p->glitched + (size_t)y * p->width;
+        int count = 0;
+        for (int x = data->start_x; x < data->end_x; x++) {
+            if (flags[x]) {
+                data->delta_out[count++] = (double)(x - p->orbit.ref_x) * zoom;
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        double dcy = (double)(y - p->orbit.ref_y) * zoom;
+        perturbation_row(data, data->delta_out, dcy, count, data->iteration_out, data->glitch_out);
+
+        Uint32* out = data->buffer + (size_t)y * data->vp->screen_width;
+        int* iterations = data->iterations + (size_t)y * data->vp->screen_width;
+        int k = 0;
+        for (int x = data->start_x; x < data->end_x; x++) {
+            if (flags[x]) {
+                iterations[x] = data->iteration_out[k];
+                out[x] = iterationColour(data, data->iteration_out[k], palette_scale);
+                flags[x] = data->glitch_out[k];
+                data->glitched_pixels += data->glitch_out[k];
+                k++;
+            }
+        }
+    }
+}
+
+// Mariani-Silver subdivision: a rectangle whose border is a single iteration count gets that count throughout,
+// since the bands between iteration counts can't hold an island that doesn't cross the border (the set is
+// connected). anything else is split in four along its middle row and column, which become the quarters'
+// borders. features thinner than a pixel that slip between border samples can be filled over
+#define MS_MIN_SIZE 6  // rectangles no wider or taller than this have their interior computed directly
+
+static inline int* msCell(struct RenderJob* data, int x, int y) {
+    return data->iterations + (size_t)y * data->vp->screen_width + x;
+}
+
+static void msRow(struct RenderJob* data, int y, int x0, int x1) {
+    if (x1 >= x0) {
+        computeSpan(data, x0, y, 1, x1 - x0 + 1, msCell(data, x0, y));
+    }
+}
+
+static void msColumn(struct RenderJob* data, int x, int y0, int y1) {
+    if (y1 >= y0) {
+        computeColumn(data, x, y0, y1 - y0 + 1);
+    }
+}
+
+// border of the rectangle (x0, y0) - (x1, y1) inclusive is already computed
+static void msRect(struct RenderJob* data, int x0, int y0, int x1, int y1) {
+    if (x1 - x0 < 2 || y1 - y0 < 2 || *(data->generation_signal) != data->generation) {
+        return;
+    }
+
+    int value = *msCell(data, x0, y0);
+    bool uniform = true;
+    for (int x = x0; x <= x1 && uniform; x++) {
+        uniform = *msCell(data, x, y0) == value && *msCell(data, x, y1) == value;
+    }
+    for (int y = y0 + 1; y < y1 && uniform; y++) {
+        uniform = *msCell(data, x0, y) == value && *msCell(data, x1, y) == value;
+    }
+
+    // a pixel the reference orbit couldn't resolve says nothing about its neighbours
+    struct Perturbation* p = data->perturb;
+    if (uniform && p) {
+        for (int x = x0; x <= x1 && uniform; x++) {
+            uniform = !p->glitched[(size_t)y0 * p->width + x] && !p->glitched[(size_t)y1 * p->width + x];
+        }
+        for (int y = y0 + 1; y < y1 && uniform; y++) {
+            uniform = !p->glitched[(size_t)y * p->width + x0] && !p->glitched[(size_t)y * p->width + x1];
+        }
+    }
+
+    if (uniform) {
+        for (int y = y0 + 1; y < y1; y++) {
+            int* cells = msCell(data, x0 + 1, y);
+            for (int i = 0; i < x1 - x0 - 1; i++) {
+                cells[i] = value;
+            }
+            if (p) {
+                memset(p->glitched + (size_t)y * p->width + x0 + 1, 0, x1 - x0 - 1);
+            }
+        }
+        return;
+    }
+
+    if (x1 - x0 <= MS_MIN_SIZE || y1 - y0 <= MS_MIN_SIZE) {
+        for (int y = y0 + 1; y < y1; y++) {
+            msRow(data, y, x0 + 1, x1 - 1);
+        }
+        return;
+    }
+
+    int mx = (x0 + x1) / 2;
+    int my = (y0 + y1) / 2;
+    msRow(data, my, x0 + 1, x1 - 1);
+    msColumn(data, mx, y0 + 1, my - 1);
+    msColumn(data, mx, my + 1, y1 - 1);
+
+    msRect(data, x0, y0, mx, my);
+    msRect(data, mx, y0, x1, my);
+    msRect(data, x0, my, mx, y1);
+    msRect(data, mx, my, x1, y1);
+}
+
+// full resolution pass of one tile by subdivision, then coloured from the iteration buffer
+static void marianiSilverTile(struct RenderJob* data, double palette_scale) {
+    int x0 = data->start_x, x1 = data->end_x - 1;
+    int y0 = data->start_y, y1 = data->end_y - 1;
+
+    msRow(data, y0, x0, x1);
+    if (y1 > y0) {
+        msRow(data, y1, x0, x1);
+    }
+    msColumn(data, x0, y0 + 1, y1 - 1);
+    if (x1 > x0) {
+        msColumn(data, x1, y0 + 1, y1 - 1);
+    }
+    msRect(data, x0, y0, x1, y1);
+
+    if (*(data->generation_signal) != data->generation) {
+        return;
+    }
+    for (int y = y0; y <= y1; y++) {
+        colourSpan(data, msCell(data, x0, y), x1 - x0 + 1, palette_scale, data->buffer + (size_t)y * data->vp->screen_width + x0);
+    }
+}
+
+// solid guessing: a sample whose neighbours on the previous pass's grid (above and below, left and right,
+// or the four diagonals) all have the same count takes that count without being iterated
+static bool guessSample(struct RenderJob* data, int x, int y, int frac, int* value) {
+    const int width = data->vp->screen_width;
+    const int coarse = frac * 2;
+    int nx = (x - data->start_x) % coarse == 0 ? 1 : 2;
+    int ny = (y - data->start_y) % coarse == 0 ? 1 : 2;
+    int first_x = nx == 1 ? x : x - frac;
+    int first_y = ny == 1 ? y : y - frac;
+
+    // neighbours must lie in this tile, anything past its edge may sit on another grid
+    if (first_x + (nx - 1) * coarse >= data->end_x || first_y + (ny - 1) * coarse >= data->end_y) {
+        return false;
+    }
+
+    struct Perturbation* p = data->perturb;
+    int guess = data->iterations[(size_t)first_y * width + first_x];
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            size_t at = (size_t)(first_y + j * coarse) * width + first_x + i * coarse;
+            if (data->iterations[at] != guess || (p && p->glitched[at])) {
+                return false;
+            }
+        }
+    }
+    *value = guess;
+    return true;
+}
+
+// samples (x + i * step, y) of a pass at render fraction frac: computed (or guessed, or reused from a
+// reprojection), stored in the iteration buffer and painted over the frac x frac block each one stands for
+// until the next pass. block pixels still showing a reprojected count keep it
+static void refineSpan(struct RenderJob* data, int x, int y, int step, int count, int frac, bool guess, double palette_scale) {
+    const int width = data->vp->screen_width;
+    int* iterations = data->iterations + (size_t)y * width;
+    unsigned char* kind = data->reproject ? data->reproject->kind : NULL;
+    int* out = data->iteration_out;
+
+    if (guess || kind) {
+        struct Perturbation* p = data->perturb;
+        for (int i = 0; i < count; i++) {
+            int px = x + i * step;
+            if (kind && kind[(size_t)y * width + px] == REPROJECT_EXACT) {
+                out[i] = iterations[px];
+            } else if (!guess || !guessSample(data, px, y, frac, &out[i])) {
+                out[i] = -1;
+                continue;
+            }
+            if (p) {
+                p->glitched[(size_t)y * p->width + px] = 0;
+            }
+        }
+        // iterate the runs that couldn't be guessed
+        for (int i = 0; i < count;) {
+            if (out[i] >= 0) {
+                i++;
+                continue;
+            }
+            int run = i + 1;
+            while (run < count && out[run] < 0) {
+                run++;
+            }
+            computeSpan(data, x + i * step, y, step, run - i, out + i);
+            i = run;
+        }
+    } else {
+        computeSpan(data, x, y, step, count, out);
+    }
+
+    for (int i = 0; i < count; i++) {
+        int px = x + i * step;
+        iterations[px] = out[i];
+        if (kind) {
+            kind[(size_t)y * width + px] = REPROJECT_NONE;
+        }
+    }
+
+    int rows = data->end_y - y < frac ? data->end_y - y : frac;
+    int step_shift = powerOfTwoShift(step);
+    if (data->use_simd && step_shift >= 0) {
+        // full resolution rows colour straight into the frame, coarser ones replicate each colour over its block
+        if (step == 1 && !kind) {
+            colourSpan(data, out, count, palette_scale, data->buffer + (size_t)y * width + x);
+            return;
+        }
+        colourSpan(data, out, count, palette_scale, data->colour_out);
+
+        int span = (count - 1) * step + frac;
+        span = x + span > data->end_x ? data->end_x - x : span;
+        for (int r = 0; r < rows; r++) {
+            const unsigned char* shown = kind ? kind + (size_t)(y + r) * width + x : NULL;
+            mandelbrot_simd_paint_row(data->colour_out, step_shift, frac, shown, span, data->buffer + (size_t)(y + r) * width + x);
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int px = x + i * step;
+        int cols = data->end_x - px < frac ? data->end_x - px : frac;
+        Uint32 colour = iterationColour(data, out[i], palette_scale);
+
+        for (int r = 0; r < rows; r++) {
+            Uint32* dst = data->buffer + (size_t)(y + r) * width + px;
+            const unsigned char* shown = kind ? kind + (size_t)(y + r) * width + px : NULL;
+            for (int k = 0; k < cols; k++) {
+                if (!shown || shown[k] == REPROJECT_NONE) {
+                    dst[k] = colour;
+                }
+            }
+        }
+    }
+}
+
+// colour the tile from the counts already in the iteration buffer
+static void recolourTile(struct RenderJob* data, double palette_scale) {
+    const int width = data->vp->screen_width;
+    for (int y = data->start_y; y < data->end_y; y++) {
+        if (*(data->generation_signal) != data->generation) {
+            return;
+        }
+        const size_t row = (size_t)y * width + data->start_x;
+        colourSpan(data, data->iterations + row, data->end_x - data->start_x, palette_scale, data->buffer + row);
+    }
+}
+
+// raise the last frame's limit: only pixels that reached it are iterated again, from their saved orbits
+// where there are any, and the tile is recoloured for the new limit
+static void resumeTile(struct RenderJob* data, double palette_scale) {
+    const int width = data->vp->screen_width;
+    int* out = data->iteration_out;
+
+    for (int y = data->start_y; y < data->end_y; y++) {
+        if (*(data->generation_signal) != data->generation) {
+            return;
+        }
+
+        int* iterations = data->iterations + (size_t)y * width;
+        const int* slot = data->orbits->slot + (size_t)y * width;
+        for (int x = data->start_x; x < data->end_x;) {
+            if (iterations[x] < data->resume_limit) {
+                x++;
+                continue;
+            }
+            if (slot[x] == ORBIT_INSIDE) {
+                iterations[x++] = data->vp->iterations;
+                continue;
+            }
+            int run = x + 1;
+            while (run < data->end_x && iterations[run] >= data->resume_limit && slot[run] != ORBIT_INSIDE) {
+                run++;
+            }
+            computeSpan(data, x, y, 1, run - x, out);
+            memcpy(iterations + x, out, (size_t)(run - x) * sizeof(int));
+            x = run;
+        }
+        colourSpan(data, iterations + data->start_x, data->end_x - data->start_x, palette_scale, data->buffer + (size_t)y * width + data->start_x);
+    }
+}
+
+// fill the tile from the last finished frame, resampled to this frame's zoom
+static void reprojectTile(struct RenderJob* data, double palette_scale) {
+    const struct Reprojection* r = data->reproject;
+    const int width = data->vp->screen_width;
+    const int count = data->end_x - data->start_x;
+    int* out = data->iteration_out;
+    unsigned char* exact = data->glitch_out;
+
+    for (int y = data->start_y; y < data->end_y; y++) {
+        if (*(data->generation_signal) != data->generation) {
+            return;
+        }
+
+        double sy = r->y0 + y * r->scale;
+        double ry = nearbyint(sy);
+        if (ry >= 0.0 && ry < r->height) {
+            bool row_exact = r->exact && fabs(sy - ry) <= REPROJECT_TOLERANCE;
+            mandelbrot_simd_reproject_row(r->source + (size_t)ry * r->width, r->width, r->x0 + data->start_x * r->scale, r->scale, row_exact,
+                                          data->vp->iterations, r->exact_limit, out, exact, count);
+        } else {
+            for (int i = 0; i < count; i++) {
+                out[i] = -1;
+            }
+        }
+
+        Uint32* pixels = data->buffer + (size_t)y * width + data->start_x;
+        int* iterations = data->iterations + (size_t)y * width + data->start_x;
+        unsigned char* kind = r->kind + (size_t)y * width + data->start_x;
+        for (int i = 0; i < count; i++) {
+            if (out[i] < 0) {
+                kind[i] = REPROJECT_NONE;
+                out[i] = 0;
+                continue;
+            }
+            kind[i] = exact[i] ? REPROJECT_EXACT : REPROJECT_PREVIEW;
+            iterations[i] = out[i];
+        }
+        colourSpan(data, out, count, palette_scale, pixels);
+        for (int i = 0; i < count; i++) {
+            if (kind[i] == REPROJECT_NONE) {
+                pixels[i] = 0;  // outside the last frame, black until the first pass reaches it
+            }
+        }
+    }
+}
+
+// counts this far apart on neighbouring pixels alias: a few iterations where they are low, an eighth of the
+// lower one deeper in, and always across the boundary of the set
+#define AA_MIN_STEP 2
+#define AA_STEP_RATIO 8
+
+static inline bool sharpStep(int a, int b, int max_iterations) {
+    if ((a >= max_iterations) != (b >= max_iterations)) {
+        return true;
+    }
+    int low = a < b ? a : b;
+    return abs(a - b) > AA_MIN_STEP + low / AA_STEP_RATIO;
+}
+
+static bool isEdge(const struct RenderJob* data, int x, int y) {
+    const int width = data->vp->screen_width;
+    const int* at = data->iterations + (size_t)y * width + x;
+    int max = data->vp->iterations;
+    return (x > 0 && sharpStep(*at, at[-1], max)) || (x + 1 < width && sharpStep(*at, at[1], max)) ||
+           (y > 0 && sharpStep(*at, at[-width], max)) || (y + 1 < data->vp->screen_height && sharpStep(*at, at[width], max));
+}
+
+static inline uint32_t aaHash(uint32_t a, uint32_t b) {
+    uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u) * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+static double radicalInverse(int i, int base) {
+    double inverse = 0.0;
+    double digit = 1.0 / base;
+    for (; i > 0; i /= base, digit /= base) {
+        inverse += (i % base) * digit;
+    }
+    return inverse;
+}
+
+// offset of subsample s on row y from its pixel's point, within half a pixel: a Halton point, so any number of
+// them covers the pixel evenly, shifted by a random rotation per row. every pixel of a row shares it, which keeps
+// the samples of a run of pixels evenly spaced for the row kernels
+static void aaOffset(int s, int y, double* dx, double* dy) {
+    double rx = aaHash((uint32_t)y, 1) * 0x1p-32;
+    double ry = aaHash((uint32_t)y, 2) * 0x1p-32;
+    *dx = fmod(radicalInverse(s + 1, 2) + rx, 1.0) - 0.5;
+    *dy = fmod(radicalInverse(s + 1, 3) + ry, 1.0) - 0.5;
+}
+
+// samples an edge pixel takes: the whole number of the frame's share, and one more with the chance of its fraction
+static int aaSamplesFor(const struct RenderJob* data, int x, int y) {
+    int samples = (int)data->aa_share;
+    if (aaHash((uint32_t)x, (uint32_t)y) * 0x1p-32 < data->aa_share - samples) {
+        samples++;
+    }
+    return samples < data->aa_samples ? samples : data->aa_samples;
+}
+
+static void aaAdd(unsigned int* sum, Uint32 colour) {
+    sum[0] += (colour >> 16) & 0xFF;
+    sum[1] += (colour >> 8) & 0xFF;
+    sum[2] += colour & 0xFF;
+    sum[3]++;
+}
+
+// count the tile's edge pixels, or (sample) average subsamples into them
+static void antialiasTile(struct RenderJob* data, double palette_scale, bool sample) {
+    const int width = data->vp->screen_width;
+    const int count = data->end_x - data->start_x;
+    unsigned char* want = data->aa_want;
+    unsigned int* sum = data->aa_sum;
+
+    for (int y = data->start_y; y < data->end_y; y++) {
+        if (*(data->generation_signal) != data->generation) {
+            return;
+        }
+
+        int row_samples = 0;
+        int most = 0;
+        for (int i = 0; i < count; i++) {
+            int x = data->start_x + i;
+            want[i] = 0;
+            if (!isEdge(data, x, y)) {
+                continue;
+            }
+            data->aa_edges++;
+            if (sample) {
+                want[i] = (unsigned char)aaSamplesFor(data, x, y);
+                row_samples += want[i];
+                most = want[i] > most ? want[i] : most;
+            }
+        }
+        if (row_samples == 0) {
+            continue;
+        }
+
+        // the budget is a hard limit; the last rows to reach it lose samples from their right
+        int taken = (*data->aa_reserved += row_samples) - row_samples;
+        int over = taken + row_samples - data->aa_budget;
+        for (int i = count - 1; i >= 0 && over > 0; i--) {
+            int cut = want[i] < over ? want[i] : over;
+            want[i] -= (unsigned char)cut;
+            over -= cut;
+        }
+
+        Uint32* pixels = data->buffer + (size_t)y * width + data->start_x;
+        for (int i = 0; i < count; i++) {
+            if (want[i] > 0) {
+                memset(sum + 4 * i, 0, 4 * sizeof(unsigned int));
+                aaAdd(sum + 4 * i, pixels[i]);
+            }
+        }
+
+        // sample s of every pixel that takes more than s, a run of neighbours at a time
+        for (int s = 0; s < most; s++) {
+            double dx, dy;
+            aaOffset(s, y, &dx, &dy);
+            for (int i = 0; i < count;) {
+                if (want[i] <= s) {
+                    i++;
+                    continue;
+                }
+                int run = i + 1;
+                while (run < count && want[run] > s) {
+                    run++;
+                }
+                subsampleSpan(data, data->start_x + i, y, dx, dy, run - i, data->iteration_out);
+                colourSpan(data, data->iteration_out, run - i, palette_scale, data->colour_out);
+                for (int k = 0; k < run - i; k++) {
+                    if (!data->glitch_out[k]) {
+                        aaAdd(sum + 4 * (i + k), data->colour_out[k]);
+                    }
+                }
+                data->aa_used += run - i;
+                i = run;
+            }
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (want[i] > 0) {
+                const unsigned int* p = sum + 4 * i;
+                unsigned int half = p[3] / 2;
+                pixels[i] = (pixels[i] & 0xFF000000u) | ((p[0] + half) / p[3]) << 16 | ((p[1] + half) / p[3]) << 8 | (p[2] + half) / p[3];
+            }
+        }
+    }
+}
+
+// add the frame's sample to the running average of each pixel of the tile; the first folds in the colours the
+// pixels already have
+static void accumulateTile(struct RenderJob* data, double palette_scale) {
+    const int width = data->vp->screen_width;
+    const int count = data->end_x - data->start_x;
+
+    for (int y = data->start_y; y < data->end_y; y++) {
+        if (*(data->generation_signal) != data->generation) {
+            return;
+        }
+
+        // carry on from the points anti-aliasing already took, so edge pixels don't take them twice
+        double dx, dy;
+        aaOffset(data->aa_samples + data->accum_sample - 1, y, &dx, &dy);
+        subsampleSpan(data, data->start_x, y, dx, dy, count, data->iteration_out);
+        colourSpan(data, data->iteration_out, count, palette_scale, data->colour_out);
+
+        Uint32* pixels = data->buffer + (size_t)y * width + data->start_x;
+        unsigned int* sum = data->accum + 4 * ((size_t)y * width + data->start_x);
+        for (int i = 0; i < count; i++) {
+            unsigned int* p = sum + 4 * i;
+            if (data->accum_sample == 1) {
+                memset(p, 0, 4 * sizeof(unsigned int));
+                aaAdd(p, pixels[i]);
+            }
+            if (!data->glitch_out[i]) {
+                aaAdd(p, data->colour_out[i]);
+            }
+            unsigned int half = p[3] / 2;
+            pixels[i] = (pixels[i] & 0xFF000000u) | ((p[0] + half) / p[3]) << 16 | ((p[1] + half) / p[3]) << 8 | (p[2] + half) / p[3];
+        }
+    }
+}
+
 void* calculateMandelbrotRoutine(void* arg) {
     struct RenderJob* data = (struct RenderJob*)arg;
-    int pitch = sizeof(Uint32) * data->vp->screen_width;
 
-    int halfWidth = data->vp->screen_width / 2;
-    int halfHeight = data->vp->screen_height / 2;
+    double palette_scale = (double)(data->palette_size) / (double)data->vp->iterations;  // for cyclic rendering
 
-    Uint8* row;
+    data->glitched_pixels = 0;
+    data->iterations_skipped = 0;
+    data->counts = (struct IterationCounts){0};
+    data->pixels_computed = 0;
+    data->aa_edges = 0;
+    data->aa_used = 0;
+    if (data->start_render_frac == ACCUMULATE_PASS) {
+        accumulateTile(data, palette_scale);
+        return NULL;
+    }
+    if (data->start_render_frac == AA_DETECT_PASS || data->start_render_frac == AA_PASS) {
+        antialiasTile(data, palette_scale, data->start_render_frac == AA_PASS);
+        return NULL;
+    }
+    if (data->fix_glitches) {
+        fixGlitches(data, palette_scale);
+        return NULL;
+    }
 
-    const double zoom = data->vp->zoom;  // DISTANCE BETWEEN PIXELS IN WORLD SPACE
-    double world_top = data->vp->current_offset_y - ((double)halfHeight * zoom);
-    double world_left = data->vp->current_offset_x - ((double)halfWidth * zoom);
+    if (data->start_render_frac == RECOLOUR_PASS) {
+        recolourTile(data, palette_scale);
+        if (data->perturb) {
+            countGlitches(data);  // still those of the frame being recoloured
+        }
+        return NULL;
+    }
+    if (data->start_render_frac == RESUME_PASS) {
+        resumeTile(data, palette_scale);
+        return NULL;
+    }
+    if (data->start_render_frac == REPROJECT_PASS) {
+        reprojectTile(data, palette_scale);
+        return NULL;
+    }
 
-    double palette_scale = (double)(data->palette_size) / (double)data->vp->iterations;  // for cyclic rendering
+    // a pass is a refinement when the frame started on a coarser grid that halves down to this one
+    int coarse_frac = data->coarse_render_frac > data->start_render_frac ? data->coarse_render_frac : data->start_render_frac;
 
     // render fraction halves; 8 -> 4 -> 2 -> 1 -> return
+    // (or stop early at end_render_frac when a scheduler runs one pass at a time)
     while (data->start_render_frac >= 1) {
-        row = (Uint8*)data->buffer + (data->start_y * pitch);
-
-        // draw onto screen
-        // render factor 8: render every 8th pixel, copy to other pixels, then half render factor + repeat until 1.
-        for (int y = data->start_y; y < data->end_y; y += data->start_render_frac) {
-            // check for quick return
-            if (*(data->kill_signal)) {
-                return NULL;
-            }
-
-            Uint32* out = (Uint32*)row;  // point to start of current row
-
-            // worldspace coordinates
-            double x0 = world_left;
-            double y0 = world_top + (double)y * zoom;
-
-            if (data->use_simd) {
-                int frac = data->start_render_frac;
-                double zoom_step = zoom * frac;
-                int pixel_count = (data->scrn_width + frac - 1) / frac;
-
-                mandelbrot_simd_row(x0, y0, zoom_step, data->vp->iterations, data->iteration_out, pixel_count, data->no_optimisations);
-                int px = 0;
-                for (int x = 0; x < data->scrn_width; x += frac, px++) {
-                    int iterations = data->iteration_out[px];
-                    Uint32 colour = data->render_smooth
-                                        ? cyclicPalette(data, iterations, palette_scale)
-                                        : data->palette[fast_map_range(iterations, data->vp->iterations, data->palette_size - 1)];
-
-                    // copy to neighbours based on current render_frac
-                    for (int k = 0; k < data->start_render_frac; k++) {
-                        if ((x + k) < data->scrn_width) {
-                            out[x + k] = colour;
-                        }
-                    }
-                }
-            } else {
-                for (int x = 0; x < data->scrn_width; x += data->start_render_frac) {
-                    int iterations = calculateMandelbrotOpts(x0, y0, data->vp->iterations, data->no_optimisations);
-
-                    // map iterations to colour data
-                    Uint32 colour = data->render_smooth
-                                        ? cyclicPalette(data, iterations, palette_scale)
-                                        : data->palette[fast_map_range(iterations, data->vp->iterations, data->palette_size - 1)];
-
-                    // copy to neighbours based on current render_frac
-                    for (int k = 0; k < data->start_render_frac; k++) {
-                        if ((x + k) < data->scrn_width) {
-                            out[x + k] = colour;
-                        }
-                    }
+        int frac = data->start_render_frac;
+
+        if (data->mariani_silver && frac == 1) {
+            marianiSilverTile(data, palette_scale);
+        } else {
+            // samples on the previous pass's grid are already in the iteration buffer
+            int ratio = coarse_frac / frac;
+            bool refine = frac < coarse_frac && coarse_frac % frac == 0 && (ratio & (ratio - 1)) == 0;
+            bool guess = refine && data->solid_guess;
 
-                    x0 += zoom * data->start_render_frac;  // update worldspace x for next loop, with respect to render_frac
+            for (int y = data->start_y; y < data->end_y; y += frac) {
+                // check for quick return
+                if (*(data->generation_signal) != data->generation) {
+                    return NULL;
                 }
-            }
 
-            // scale to fullres despite lowres renderfrac
-            for (int p = 1; p < data->start_render_frac; p++) {
-                int target_y = y + p;
-                if (target_y < data->end_y) {
-                    Uint8* src = (Uint8*)data->buffer + (y * pitch);
-                    Uint8* dst = (Uint8*)data->buffer + (target_y * pitch);
-                    memcpy(dst, src, pitch);
+                if (refine && (y - data->start_y) % (frac * 2) == 0) {
+                    // previous pass's row, only the samples between its samples are new
+                    int pixel_count = (data->end_x - data->start_x - frac + frac * 2 - 1) / (frac * 2);
+                    refineSpan(data, data->start_x + frac, y, frac * 2, pixel_count, frac, guess, palette_scale);
+                } else {
+                    int pixel_count = (data->end_x - data->start_x + frac - 1) / frac;
+                    refineSpan(data, data->start_x, y, frac, pixel_count, frac, guess, palette_scale);
                 }
             }
-            row += pitch * data->start_render_frac;  // update worldspace y for next loop
         }
-        if (data->start_render_frac == 1) {
+
+        if (frac == 1 && data->perturb && *(data->generation_signal) == data->generation) {
+            countGlitches(data);
+        }
+        if (frac <= 1 || frac <= data->end_render_frac) {
             return NULL;
         }
         data->start_render_frac /= 2;
     }
     return NULL;
-}
\ No newline at end of file
+}
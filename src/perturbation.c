@@ -0,0 +1,350 @@
+#include "perturbation.h"
+#include "apfloat.h"
+#include "inputHandler.h"
+#include "simd_handler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// reference orbits can run for the full iteration count, poll for a newer frame this often
+#define CANCEL_CHECK_INTERVAL 1024
+
+int perturbation_init(struct Perturbation* p, int width, int height) {
+    p->orbit.zr = NULL;
+    p->orbit.zi = NULL;
+    p->orbit.glitch_bound = NULL;
+    p->orbit.length = 0;
+    p->orbit.capacity = 0;
+    p->orbit.ref_x = width / 2;
+    p->orbit.ref_y = height / 2;
+    p->orbit.bla = NULL;
+    p->orbit.bla_levels = 0;
+    p->orbit.bla_capacity = 0;
+    p->width = width;
+    p->height = height;
+    p->references = 0;
+
+    p->glitched = calloc((size_t)width * height, 1);
+    if (!p->glitched) {
+        fprintf(stderr, "Failed to allocate glitch map\n");
+        return 1;
+    }
+    return 0;
+}
+
+void perturbation_free(struct Perturbation* p) {
+    free(p->orbit.zr);
+    free(p->orbit.zi);
+    free(p->orbit.glitch_bound);
+    free(p->orbit.bla);
+    free(p->glitched);
+    p->orbit.bla = NULL;
+    p->orbit.bla_capacity = 0;
+    p->orbit.zr = NULL;
+    p->orbit.zi = NULL;
+    p->orbit.glitch_bound = NULL;
+    p->glitched = NULL;
+    p->orbit.capacity = 0;
+}
+
+static bool reserve_orbit(struct ReferenceOrbit* orbit, int length) {
+    if (orbit->capacity >= length) {
+        return true;
+    }
+    double* zr = realloc(orbit->zr, length * sizeof(double));
+    if (zr) {
+        orbit->zr = zr;
+    }
+    double* zi = realloc(orbit->zi, length * sizeof(double));
+    if (zi) {
+        orbit->zi = zi;
+    }
+    double* bound = realloc(orbit->glitch_bound, length * sizeof(double));
+    if (bound) {
+        orbit->glitch_bound = bound;
+    }
+    if (!zr || !zi || !bound) {
+        fprintf(stderr, "Failed to allocate reference orbit\n");
+        return false;
+    }
+    orbit->capacity = length;
+    return true;
+}
+
+// combine step x followed by step y; max_dc bounds |dc| anywhere on screen
+static struct BLAStep merge_steps(const struct BLAStep* x, const struct BLAStep* y, double max_dc) {
+    struct BLAStep z;
+    z.ar = y->ar * x->ar - y->ai * x->ai;
+    z.ai = y->ar * x->ai + y->ai * x->ar;
+    z.br = y->ar * x->br - y->ai * x->bi + y->br;
+    z.bi = y->ar * x->bi + y->ai * x->br + y->bi;
+    z.steps = x->steps + y->steps;
+
+    // dz after x must still be inside y's radius: |Ax| |dz| + |Bx| |dc| < Ry
+    double ax = hypot(x->ar, x->ai);
+    double ry = ax > 0.0 ? (sqrt(y->r2) - hypot(x->br, x->bi) * max_dc) / ax : 0.0;
+    double r = fmin(sqrt(x->r2), fmax(0.0, ry));
+    z.r2 = r * r;
+    return z;
+}
+
+// bilinear approximation tables for the current orbit; skipping is disabled if they don't fit in memory
+static void build_bla(struct ReferenceOrbit* orbit, double max_dc) {
+    orbit->bla_levels = 0;
+
+    // single steps m -> m + 1 for m in [1, length - 2], so the last orbit entry is always iterated
+    int count = orbit->length - 2;
+    if (count < 1) {
+        return;
+    }
+    if (orbit->bla_capacity < 2 * count) {
+        struct BLAStep* bla = realloc(orbit->bla, 2 * (size_t)count * sizeof(struct BLAStep));
+        if (!bla) {
+            fprintf(stderr, "Failed to allocate approximation table, rendering without it\n");
+            return;
+        }
+        orbit->bla = bla;
+        orbit->bla_capacity = 2 * count;
+    }
+
+    // one step: dz' = 2Z dz + dc, dropping dz^2 is safe while |dz| < epsilon |2Z|
+    // and the skipped escape check can't fire while |dz| < 2 - |Z|
+    for (int j = 0; j < count; j++) {
+        struct BLAStep* step = &orbit->bla[j];
+        double ar = 2.0 * orbit->zr[1 + j];
+        double ai = 2.0 * orbit->zi[1 + j];
+        double r = fmin(BLA_EPSILON * hypot(ar, ai), fmax(0.0, 2.0 - 0.5 * hypot(ar, ai)));
+        step->ar = ar;
+        step->ai = ai;
+        step->br = 1.0;
+        step->bi = 0.0;
+        step->r2 = r * r;
+        step->steps = 1;
+    }
+    orbit->bla_offset[0] = 0;
+    orbit->bla_count[0] = count;
+    orbit->bla_levels = 1;
+
+    // each level merges neighbouring pairs of the one below
+    int offset = count;
+    while (orbit->bla_levels < BLA_MAX_LEVELS && orbit->bla_count[orbit->bla_levels - 1] >= 2) {
+        const struct BLAStep* below = orbit->bla + orbit->bla_offset[orbit->bla_levels - 1];
+        int pairs = orbit->bla_count[orbit->bla_levels - 1] / 2;
+        for (int j = 0; j < pairs; j++) {
+            orbit->bla[offset + j] = merge_steps(&below[2 * j], &below[2 * j + 1], max_dc);
+        }
+        orbit->bla_offset[orbit->bla_levels] = offset;
+        orbit->bla_count[orbit->bla_levels] = pairs;
+        orbit->bla_levels++;
+        offset += pairs;
+    }
+}
+
+const struct BLAStep* perturbation_bla_lookup(const struct ReferenceOrbit* ref, int m, double dz2, int limit) {
+    if (m < 1) {
+        return NULL;
+    }
+    int i = m - 1;
+    for (int k = ref->bla_levels - 1; k >= 0; k--) {
+        int j = i >> k;
+        if ((i & ((1 << k) - 1)) != 0 || j >= ref->bla_count[k]) {
+            continue;
+        }
+        const struct BLAStep* step = &ref->bla[ref->bla_offset[k] + j];
+        if (dz2 < step->r2 && m + step->steps <= limit) {
+            return step;
+        }
+    }
+    return NULL;
+}
+
+// new reference: the glitched pixel closest to the centroid of all glitched pixels,
+// which tends to land inside the blob whose dynamics the previous reference missed
+static bool pick_reference(struct Perturbation* p, int* ref_x, int* ref_y) {
+    double sum_x = 0.0, sum_y = 0.0;
+    long count = 0;
+    for (int y = 0; y < p->height; y++) {
+        const unsigned char* row = p->glitched + (size_t)y * p->width;
+        for (int x = 0; x < p->width; x++) {
+            if (row[x]) {
+                sum_x += x;
+                sum_y += y;
+                count++;
+            }
+        }
+    }
+    if (count == 0) {
+        return false;
+    }
+
+    double cx = sum_x / count;
+    double cy = sum_y / count;
+    double best = INFINITY;
+    for (int y = 0; y < p->height; y++) {
+        const unsigned char* row = p->glitched + (size_t)y * p->width;
+        for (int x = 0; x < p->width; x++) {
+            double dist = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+            if (row[x] && dist < best) {
+                best = dist;
+                *ref_x = x;
+                *ref_y = y;
+            }
+        }
+    }
+    return true;
+}
+
+bool perturbation_prepare(struct Perturbation* p, const struct RenderJob* frame, bool rereference) {
+    const struct viewport* vp = frame->vp;
+    struct ReferenceOrbit* orbit = &p->orbit;
+
+    int ref_x = vp->screen_width / 2;
+    int ref_y = vp->screen_height / 2;
+    if (rereference) {
+        if (!pick_reference(p, &ref_x, &ref_y)) {
+            return false;
+        }
+    } else {
+        p->references = 0;
+    }
+
+    if (!reserve_orbit(orbit, vp->iterations)) {
+        return false;
+    }
+
+    // reference c at full precision: centre + pixel offset
+    struct apfloat cr, ci;
+    ap_add_double(&cr, &vp->centre_x, (double)(ref_x - vp->screen_width / 2) * vp->zoom);
+    ap_add_double(&ci, &vp->centre_y, (double)(ref_y - vp->screen_height / 2) * vp->zoom);
+
+    struct apfloat zr, zi, zr2, zi2, zri;
+    ap_from_double(&zr, 0.0);
+    ap_from_double(&zi, 0.0);
+
+    int length = vp->iterations;
+    for (int n = 0; n < vp->iterations; n++) {
+        if (n % CANCEL_CHECK_INTERVAL == 0 && *(frame->generation_signal) != frame->generation) {
+            return false;
+        }
+
+        double x = ap_to_double(&zr);
+        double y = ap_to_double(&zi);
+        double mag = x * x + y * y;
+        orbit->zr[n] = x;
+        orbit->zi[n] = y;
+        orbit->glitch_bound[n] = GLITCH_TOLERANCE * mag;
+
+        // keep the escaping value so pixels can escape alongside the reference
+        if (mag > 4.0) {
+            length = n + 1;
+            break;
+        }
+
+        // Z = Z^2 + c
+        ap_mul(&zr2, &zr, &zr);
+        ap_mul(&zi2, &zi, &zi);
+        ap_mul(&zri, &zr, &zi);
+        ap_sub(&zr, &zr2, &zi2);
+        ap_add(&zr, &zr, &cr);
+        ap_add(&zi, &zri, &zri);
+        ap_add(&zi, &zi, &ci);
+    }
+
+    orbit->length = length;
+    orbit->ref_x = ref_x;
+    orbit->ref_y = ref_y;
+    build_bla(orbit, vp->zoom * hypot(vp->screen_width, vp->screen_height));
+    p->references++;
+    return true;
+}
+
+// delta iteration dz' = (2Z + dz) dz + dc, where the pixel's z = Z + dz
+int perturbation_pixel(const struct ReferenceOrbit* ref, double dcx, double dcy, int max_iterations, unsigned char* glitched,
+                       long long* skipped, struct IterationCounts* counts) {
+    int limit = ref->length < max_iterations ? ref->length : max_iterations;
+    double dzr = 0.0;
+    double dzi = 0.0;
+    int n = 0;
+    int jumped = 0;
+
+    // z_1 = dc, then jump ahead while dz is small enough for the linear steps to hold;
+    // no escape or glitch is possible inside a valid step since z stays within epsilon of Z
+    if (limit > 1) {
+        dzr = dcx;
+        dzi = dcy;
+        n = 1;
+        const struct BLAStep* step;
+        while ((step = perturbation_bla_lookup(ref, n, dzr * dzr + dzi * dzi, limit)) != NULL) {
+            double next_r = step->ar * dzr - step->ai * dzi + step->br * dcx - step->bi * dcy;
+            dzi = step->ar * dzi + step->ai * dzr + step->br * dcy + step->bi * dcx;
+            dzr = next_r;
+            n += step->steps;
+        }
+        jumped = n - 1;
+        *skipped += jumped;
+    }
+
+    for (; n < limit; n++) {
+        double zr = ref->zr[n] + dzr;
+        double zi = ref->zi[n] + dzi;
+        double mag = zr * zr + zi * zi;
+
+        if (mag > 4.0) {
+            *glitched = 0;
+            break;
+        }
+        // |z| tiny compared to |Z|: dz has lost the precision it needs
+        if (mag < ref->glitch_bound[n]) {
+            *glitched = 1;
+            break;
+        }
+
+        double tr = 2.0 * ref->zr[n] + dzr;
+        double ti = 2.0 * ref->zi[n] + dzi;
+        double next_r = tr * dzr - ti * dzi + dcx;
+        dzi = tr * dzi + ti * dzr + dcy;
+        dzr = next_r;
+    }
+
+    // steps taken one at a time, z_1 = dc among them
+    counts->iterations += n - jumped;
+    counts->lane_steps += n - jumped;
+    if (n < limit) {
+        return n;
+    }
+
+    // still bounded after the reference escaped, this pixel needs a reference of its own
+    *glitched = limit < max_iterations;
+    return limit;
+}
+
+void perturbation_row(struct RenderJob* data, const double* dcx, double dcy, int pixel_count, int* out_iterations,
+                      unsigned char* glitched) {
+    const struct ReferenceOrbit* ref = &data->perturb->orbit;
+    int max_iterations = data->vp->iterations;
+
+    if (data->use_simd) {
+        mandelbrot_simd_perturb_row(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, &data->iterations_skipped,
+                                    &data->counts);
+        return;
+    }
+    for (int i = 0; i < pixel_count; i++) {
+        out_iterations[i] = perturbation_pixel(ref, dcx[i], dcy, max_iterations, &glitched[i], &data->iterations_skipped, &data->counts);
+    }
+}
+
+void perturbation_column(struct RenderJob* data, double dcx, const double* dcy, int pixel_count, int* out_iterations,
+                         unsigned char* glitched) {
+    const struct ReferenceOrbit* ref = &data->perturb->orbit;
+    int max_iterations = data->vp->iterations;
+
+    if (data->use_simd) {
+        mandelbrot_simd_perturb_column(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, &data->iterations_skipped,
+                                       &data->counts);
+        return;
+    }
+    for (int i = 0; i < pixel_count; i++) {
+        out_iterations[i] = perturbation_pixel(ref, dcx, dcy[i], max_iterations, &glitched[i], &data->iterations_skipped, &data->counts);
+    }
+}
@@ -5,6 +5,9 @@
 
 #include "simd_handler.h"
 #include "mandelbrot.h"
+#include "perturbation.h"
+
+#include <math.h>
 
 // highway foreach_target will repeatedly compile this file with different
 // SIMD targets to allow dynamic runtime selection of the best technology
@@ -23,9 +26,182 @@ static HWY_INLINE bool isKnownInside(double cx, double cy) {
     return q * (q + x) <= 0.25 * cy * cy;
 }
 
-void SimdRow(double x0_start, double y0, double zoom, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations) {
-    const hn::ScalableTag<double> d;  // uses widest SIMD register availible for doubles, to allow highest level of parallel
+// independent pixel vectors stepped together in SimdRow: one vector's z^2 + c is a chain of dependent
+// multiplies and adds, so several are interleaved to cover that latency. x86 before AVX-512 has 16
+// vector registers and spills past two groups of state, the other targets have 32
+#if HWY_ARCH_X86 && HWY_TARGET > HWY_AVX3
+constexpr int kRowVectors = 2;
+#else
+constexpr int kRowVectors = 4;
+#endif
+
+// the pixels of one row, handed out to SIMD lanes as they free up. a column's pixels sit at
+// (x0_start, y0 + (y_first + px) * zoom), which rounds each one's cy exactly as its own row's y0 does
+struct RowCursor {
+    double x0_start, y0, zoom;
+    bool column;
+    int y_first;
+    int max_iterations;
+    int* out_iterations;
+    int pixel_count;
+    bool no_optimisations;
+    const OrbitState* orbit_in;  // per pixel orbit to continue from, NULL starts every pixel at z = 0
+    OrbitState* orbit_out;       // per pixel orbit of the pixels left at the limit, may be orbit_in
+    int next;              // first pixel not yet handed out
+    int live;                 // lanes holding a pixel
+    IterationCounts* counts;  // iterations run by retired pixels, pixels answered without a lane
+};
+
+static HWY_INLINE double PixelX(const RowCursor* row, int px) {
+    return row->column ? row->x0_start : row->x0_start + px * row->zoom;
+}
+
+static HWY_INLINE double PixelY(const RowCursor* row, int px) {
+    return row->column ? row->y0 + (double)(row->y_first + px) * row->zoom : row->y0;
+}
+
+// next pixel of the row that needs iterating, -1 once the row has run out
+// pixels inside the main bulb or cardioid, or continued from an orbit that already escaped, are answered on
+// the way without taking a lane
+static HWY_INLINE int NextPixel(RowCursor* row) {
+    while (row->next < row->pixel_count) {
+        int px = row->next++;
+        const OrbitState* orbit = row->orbit_in ? &row->orbit_in[px] : NULL;
+        if (orbit && orbit->x * orbit->x + orbit->y * orbit->y > 4.0) {
+            // escaped on the last step of the limit it was saved at, a refilled lane would step past that
+            row->out_iterations[px] = orbit->iterations;
+            continue;
+        }
+        if (orbit || row->no_optimisations || !isKnownInside(PixelX(row, px), PixelY(row, px))) {
+            return px;
+        }
+        row->out_iterations[px] = row->max_iterations;
+        row->counts->inside++;
+        if (row->orbit_out) {
+            row->orbit_out[px].iterations = 0;  // inside at any limit
+        }
+    }
+    return -1;
+}
+
+// state a lane takes pixel px up with: its saved orbit when continuing one, else z = 0
+// idle lanes (px < 0) hold NaN, see LoadLanes
+static HWY_INLINE void StartLane(RowCursor* row, int px, double* cx, double* cy, double* x, double* y, double* iter, double* oldx,
+                                 double* oldy) {
+    *cx = px >= 0 ? PixelX(row, px) : 0.0;
+    *cy = px >= 0 ? PixelY(row, px) : 0.0;
+    *x = px >= 0 ? 0.0 : NAN;
+    *y = 0.0;
+    *iter = px >= 0 ? 0.0 : NAN;
+    *oldx = 0.0;
+    *oldy = 0.0;
+    if (px >= 0 && row->orbit_in) {
+        const OrbitState* orbit = &row->orbit_in[px];
+        *cx = orbit->cx;
+        *x = orbit->x;
+        *y = orbit->y;
+        *iter = orbit->iterations;
+        *oldx = orbit->oldx;
+        *oldy = orbit->oldy;
+        row->counts->iterations -= orbit->iterations;  // only the new iterations count
+    }
+}
+
+// idle lanes hold z = NaN and a NaN count, which fail every comparison in SimdRowGroups, so they never finish
+// and need no mask in the hot loop (the SIMD unit is built without fast-math, see CMakeLists.txt)
+template <class D, class V>
+static HWY_INLINE void LoadLanes(D d, RowCursor* row, int* lane_pixel, V& cx, V& cy, V& x, V& y, V& iter, V& oldx, V& oldy) {
+    const int N = hn::Lanes(d);
+    HWY_ALIGN double cx_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double cy_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double x_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double y_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double iter_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double oldx_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double oldy_arr[HWY_MAX_BYTES / sizeof(double)];
+    for (int i = 0; i < N; i++) {
+        int px = NextPixel(row);
+        lane_pixel[i] = px;
+        StartLane(row, px, &cx_arr[i], &cy_arr[i], &x_arr[i], &y_arr[i], &iter_arr[i], &oldx_arr[i], &oldy_arr[i]);
+        row->live += px >= 0;
+    }
+    cx = hn::Load(d, cx_arr);
+    cy = hn::Load(d, cy_arr);
+    x = hn::Load(d, x_arr);
+    y = hn::Load(d, y_arr);
+    iter = hn::Load(d, iter_arr);
+    oldx = hn::Load(d, oldx_arr);
+    oldy = hn::Load(d, oldy_arr);
+}
+
+// write out the finished lanes of one vector and reload them with the next pixels of the row
+template <class D, class V, class M>
+static HWY_NOINLINE void RetireLanes(D d, RowCursor* row, int* lane_pixel, M done, M escaped, V& cx, V& cy, V& x, V& y, V& iter,
+                                     V& oldx, V& oldy) {
     const int N = hn::Lanes(d);
+    HWY_ALIGN double cx_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double cy_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double x_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double y_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double iter_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double oldx_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double oldy_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double result_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double done_arr[HWY_MAX_BYTES / sizeof(double)];
+
+    // escaped lanes report their iteration, lanes at the limit or caught by the periodicity check report the limit
+    hn::Store(hn::IfThenElse(escaped, iter, hn::Set(d, (double)row->max_iterations)), d, result_arr);
+    hn::Store(hn::IfThenElseZero(done, hn::Set(d, 1.0)), d, done_arr);
+    hn::Store(cx, d, cx_arr);
+    hn::Store(cy, d, cy_arr);
+    hn::Store(x, d, x_arr);
+    hn::Store(y, d, y_arr);
+    hn::Store(iter, d, iter_arr);
+    hn::Store(oldx, d, oldx_arr);
+    hn::Store(oldy, d, oldy_arr);
+
+    for (int i = 0; i < N; i++) {
+        if (done_arr[i] == 0.0) {
+            continue;
+        }
+        row->out_iterations[lane_pixel[i]] = (int)result_arr[i];
+        row->counts->iterations += (long long)iter_arr[i];
+        row->counts->periodic += result_arr[i] == row->max_iterations && iter_arr[i] < row->max_iterations;
+        if (row->orbit_out && result_arr[i] == row->max_iterations) {
+            // below the limit when the periodicity check caught it; a lane escaping on the last step ends at the limit too
+            OrbitState* orbit = &row->orbit_out[lane_pixel[i]];
+            orbit->cx = cx_arr[i];
+            orbit->x = x_arr[i];
+            orbit->y = y_arr[i];
+            orbit->oldx = oldx_arr[i];
+            orbit->oldy = oldy_arr[i];
+            orbit->iterations = (int)iter_arr[i];
+        }
+
+        int px = NextPixel(row);
+        lane_pixel[i] = px;
+        StartLane(row, px, &cx_arr[i], &cy_arr[i], &x_arr[i], &y_arr[i], &iter_arr[i], &oldx_arr[i], &oldy_arr[i]);
+        row->live -= px < 0;
+    }
+
+    cx = hn::Load(d, cx_arr);
+    cy = hn::Load(d, cy_arr);
+    x = hn::Load(d, x_arr);
+    y = hn::Load(d, y_arr);
+    iter = hn::Load(d, iter_arr);
+    oldx = hn::Load(d, oldx_arr);
+    oldy = hn::Load(d, oldy_arr);
+}
+
+// K vectors of lanes, each lane refilled with the next pixel of the row as soon as its own pixel finishes,
+// so one slow pixel no longer holds its finished neighbours hostage and the vectors stay full until the
+// row runs out. the K vectors share a single escape branch per step
+// a column's cy differs per lane, a row's is the one y0 and needs no register per vector
+template <int K, bool kColumn>
+static HWY_INLINE void SimdRowGroups(RowCursor* row) {
+    const hn::ScalableTag<double> d;  // uses widest SIMD register availible for doubles, to allow highest level of parallel
+    using V = hn::Vec<decltype(d)>;
+    using M = hn::Mask<decltype(d)>;
 
     // set constants used in hotloop across all lanes (v=vector)
     // SSE4, 2 lanes: vFour = [4.0, 4.0]
@@ -33,113 +209,699 @@ void SimdRow(double x0_start, double y0, double zoom, int max_iterations, int* o
 
     const auto vFour = hn::Set(d, 4.0);
     const auto vOne = hn::Set(d, 1.0);
-    const auto vY0 = hn::Set(d, y0);
-    const auto vMax = hn::Set(d, (double)max_iterations);
-    const auto vStep = hn::Set(d, zoom);
+    const auto vY0 = hn::Set(d, row->y0);
+    const auto vMax = hn::Set(d, (double)row->max_iterations);
+    const auto vPeriodStart = hn::Set(d, 50.0);
+    const auto vEpsilon = hn::Set(d, 1e-24);
 
-    HWY_ALIGN double sequence_arr[HWY_MAX_BYTES / sizeof(double)];
-    for (int i = 0; i < N; i++) {
-        sequence_arr[i] = (double)i;
+    int lane_pixel[K][HWY_MAX_BYTES / sizeof(double)];  // pixel held by each lane, -1 when idle
+    V cx[K], cy[K], x[K], y[K], iter[K], oldx[K], oldy[K];
+    for (int k = 0; k < K; k++) {
+        LoadLanes(d, row, lane_pixel[k], cx[k], cy[k], x[k], y[k], iter[k], oldx[k], oldy[k]);
+    }
+    if (row->live == 0) {
+        return;
     }
-    const auto vSequence = hn::Load(d, sequence_arr);  // [0.0, 1.0, 2.0, 3.0...]
-    const auto all_lanes = hn::FirstN(d, N);           // bitset for masking complete lanes
 
-    HWY_ALIGN double result_arr[HWY_MAX_BYTES / sizeof(double)];
+    // iterating mandelbrot formula z = z^2 + c per lane, iter counts each lane's own iterations
+    int cd = 20;
+    long long steps = 0;
+    for (;;) {
+        V x2[K], y2[K];
+        M escaped[K], done[K];
+        auto any_done = hn::MaskFalse(d);
+        for (int k = 0; k < K; k++) {
+            x2[k] = hn::Mul(x[k], x[k]);
+            y2[k] = hn::Mul(y[k], y[k]);
+            auto mag2 = hn::Add(x2[k], y2[k]);
+            escaped[k] = hn::Gt(mag2, vFour);
+            done[k] = hn::Or(escaped[k], hn::Ge(iter[k], vMax));
 
-    // iterating mandelbrot formula z = z^2 + c
-    // c = x0_start + px * zoom + pixel_offset * zoom
-    //
-    // [x0_start + px * zoom] are constants per batch, [pixel_offset * zoom] are vectorized
+            // periodic distance check, every 20 steps for whichever lanes are past their 50th iteration
+            if (!row->no_optimisations && cd == 1) {
+                auto dx = hn::Sub(x[k], oldx[k]);
+                auto dy = hn::Sub(y[k], oldy[k]);
+                auto d2 = hn::Add(hn::Mul(dx, dx), hn::Mul(dy, dy));
+                auto ref = hn::Mul(vEpsilon, hn::Add(mag2, vOne));
+                done[k] = hn::Or(done[k], hn::And(hn::Gt(iter[k], vPeriodStart), hn::Lt(d2, ref)));
+                oldx[k] = x[k];
+                oldy[k] = y[k];
+            }
+            any_done = hn::Or(any_done, done[k]);
+        }
+        cd = cd == 1 ? 20 : cd - 1;
 
-    int px = 0;
-    for (; px + (int)N <= pixel_count; px += (int)N) {
-        // compute constant C
-        auto cx_vec = hn::Add(hn::Set(d, x0_start + px * zoom),
-                              hn::Mul(vSequence, vStep));
+        // one branch for the whole group, finished lanes are rare next to iterations
+        if (HWY_UNLIKELY(!hn::AllFalse(d, any_done))) {
+            for (int k = 0; k < K; k++) {
+                if (!hn::AllFalse(d, done[k])) {
+                    RetireLanes(d, row, lane_pixel[k], done[k], escaped[k], cx[k], cy[k], x[k], y[k], iter[k], oldx[k], oldy[k]);
+                    x2[k] = hn::Mul(x[k], x[k]);
+                    y2[k] = hn::Mul(y[k], y[k]);
+                }
+            }
+            if (row->live == 0) {
+                break;
+            }
+        }
 
-        const auto vZero = hn::Zero(d);
-        auto escaped = hn::Lt(vZero, vZero);  // all-false mask (0 < 0 is never true)
+        // compute next iteration
+        // idle lanes keep stepping too, avoiding additional conditional checks
+        for (int k = 0; k < K; k++) {
+            auto twox = hn::Add(x[k], x[k]);
+            y[k] = hn::MulAdd(twox, y[k], kColumn ? cy[k] : vY0);
+            x[k] = hn::Add(hn::Sub(x2[k], y2[k]), cx[k]);
+            iter[k] = hn::Add(iter[k], vOne);
+        }
+        steps++;
+    }
 
-        if (!no_optimisations) {
-            // bulb check
-            auto x1 = hn::Add(cx_vec, vOne);
-            auto cy2 = hn::Set(d, y0 * y0);
-            auto bulb = hn::Le(hn::Add(hn::Mul(x1, x1), cy2), hn::Set(d, 0.0625));
+    row->counts->lane_steps += steps * K * (long long)hn::Lanes(d);
+}
 
-            // cardioid check
-            auto xm = hn::Sub(cx_vec, hn::Set(d, 0.25));
-            auto q = hn::Add(hn::Mul(xm, xm), cy2);
-            auto cardiod = hn::Le(hn::Mul(q, hn::Add(q, xm)),
-                                  hn::Mul(hn::Set(d, 0.25), cy2));
+void SimdRow(double x0_start, double y0, double zoom, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations,
+             const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    if (max_iterations <= 0) {
+        for (int px = 0; px < pixel_count; px++) {
+            out_iterations[px] = max_iterations;
+            if (orbit_out) {
+                orbit_out[px].iterations = 0;
+            }
+        }
+        return;
+    }
 
-            escaped = hn::Or(bulb, cardiod);
+    RowCursor row = {x0_start, y0, zoom, false, 0, max_iterations, out_iterations, pixel_count, no_optimisations,
+                     orbit_in, orbit_out, 0, 0, counts};
+    SimdRowGroups<kRowVectors, false>(&row);
+}
+
+// SimdRow down a column: pixel px is at (x0, y_origin + (y_first + px) * zoom)
+void SimdColumn(double x0, double y_origin, int y_first, double zoom, int max_iterations, int* out_iterations, int pixel_count,
+                bool no_optimisations, const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    if (max_iterations <= 0) {
+        SimdRow(x0, y_origin, zoom, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out, counts);
+        return;
+    }
+
+    RowCursor row = {x0, y_origin, zoom, true, y_first, max_iterations, out_iterations, pixel_count, no_optimisations,
+                     orbit_in, orbit_out, 0, 0, counts};
+    SimdRowGroups<kRowVectors, true>(&row);
+}
+
+// float32 version of the SimdRow iteration for shallow zooms, twice the lanes per register
+// float rounding shifts each pixel's c by far less than a pixel where select_precision() allows it,
+// so the output differs from SimdRow only as much as resampling at a sub-pixel offset would
+// a column's pixels are at (x0_start, y0 + (y_first + px) * zoom), see RowCursor. orbits are saved and
+// continued as SimdRow's are, holding float values, so a continued orbit keeps to float arithmetic
+template <bool kColumn>
+static HWY_INLINE void SimdSpanF32(double x0_start, double y0, int y_first, double zoom, int max_iterations, int* out_iterations,
+                                   int pixel_count, bool no_optimisations, const OrbitState* orbit_in, OrbitState* orbit_out,
+                                   IterationCounts* counts) {
+    const hn::ScalableTag<float> d;
+    const int N = hn::Lanes(d);
+
+    const auto vFour = hn::Set(d, 4.0f);
+    const auto vOne = hn::Set(d, 1.0f);
+    const auto vMax = hn::Set(d, (float)max_iterations);  // exact, iteration limits stay below 2^24
+    const auto all_lanes = hn::FirstN(d, N);
+
+    HWY_ALIGN float cx_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float cy_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float x_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float y_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float oldx_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float oldy_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float start_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float result_arr[HWY_MAX_BYTES / sizeof(float)];
+    HWY_ALIGN float steps_arr[HWY_MAX_BYTES / sizeof(float)];
+
+    for (int px = 0; px < pixel_count; px += N) {
+        int lanes = pixel_count - px < N ? pixel_count - px : N;
+        // pixel coordinates are formed in double and rounded once so they don't drift along the row
+        for (int i = 0; i < N; i++) {
+            int lane = px + (i < lanes ? i : 0);
+            cx_arr[i] = (float)(kColumn ? x0_start : x0_start + lane * zoom);
+            cy_arr[i] = (float)(kColumn ? y0 + (double)(y_first + lane) * zoom : y0);
+            x_arr[i] = y_arr[i] = oldx_arr[i] = oldy_arr[i] = start_arr[i] = 0.0f;
+            if (orbit_in) {
+                const OrbitState* orbit = &orbit_in[lane];
+                cx_arr[i] = (float)orbit->cx;
+                x_arr[i] = (float)orbit->x;
+                y_arr[i] = (float)orbit->y;
+                oldx_arr[i] = (float)orbit->oldx;
+                oldy_arr[i] = (float)orbit->oldy;
+                start_arr[i] = (float)orbit->iterations;
+            }
+        }
+        const auto cx_vec = hn::Load(d, cx_arr);
+        const auto cy_vec = hn::Load(d, cy_arr);
+        const auto cy2 = hn::Mul(cy_vec, cy_vec);
+
+        auto escaped = hn::Not(hn::FirstN(d, lanes));  // row tail runs with the spare lanes already finished
+        if (!no_optimisations && !orbit_in) {
+            auto x1 = hn::Add(cx_vec, vOne);
+            auto bulb = hn::Le(hn::MulAdd(x1, x1, cy2), hn::Set(d, 0.0625f));
+            auto xm = hn::Sub(cx_vec, hn::Set(d, 0.25f));
+            auto q = hn::MulAdd(xm, xm, cy2);
+            auto cardioid = hn::Le(hn::Mul(q, hn::Add(q, xm)), hn::Mul(hn::Set(d, 0.25f), cy2));
+            auto inside = hn::And(hn::Or(bulb, cardioid), hn::FirstN(d, lanes));
+            counts->inside += (long long)hn::CountTrue(d, inside);
+            escaped = hn::Or(escaped, inside);
         }
 
         auto escaped_iter = vMax;
-        auto x_vec = hn::Zero(d);
-        auto y_vec = hn::Zero(d);
-
-        // stop iterating if all lanes have escaped (only possible when optimisations on)
-        if (!no_optimisations && hn::AllFalse(d, hn::AndNot(escaped, all_lanes))) {
-            hn::Store(escaped_iter, d, result_arr);
-            for (int i = 0; i < N; i++) {
-                out_iterations[px + i] = (int)result_arr[i];
+        // new steps each lane takes, as far as the limit unless it finishes first
+        auto lane_steps = hn::IfThenZeroElse(escaped, hn::Sub(vMax, hn::Load(d, start_arr)));
+        auto x_vec = hn::Load(d, x_arr);
+        auto y_vec = hn::Load(d, y_arr);
+        auto oldx = hn::Load(d, oldx_arr);
+        auto oldy = hn::Load(d, oldy_arr);
+        int cd = 20;
+        int steps = 0;
+
+        // lane counts run from their orbit's start, so continued lanes reach the limit at different steps:
+        // each stage runs to the step the lanes with the latest start get there, and leaves them behind with
+        // their orbits stored back in x_arr.. (kept out of registers, the hot loop needs them all)
+        int n = 0;
+        bool running = !hn::AllFalse(d, hn::AndNot(escaped, all_lanes));
+        while (running) {
+            const int stop = max_iterations - (int)hn::ReduceMax(d, hn::IfThenZeroElse(escaped, hn::Load(d, start_arr)));
+            for (; n < stop; n++) {
+                auto x2 = hn::Mul(x_vec, x_vec);
+                auto y2 = hn::Mul(y_vec, y_vec);
+                auto mag2 = hn::Add(x2, y2);
+
+                auto esc_now = hn::AndNot(escaped, hn::Gt(mag2, vFour));
+                if (!hn::AllFalse(d, esc_now)) {
+                    escaped_iter = hn::IfThenElse(esc_now, hn::Add(hn::Load(d, start_arr), hn::Set(d, (float)n)), escaped_iter);
+                    lane_steps = hn::IfThenElse(esc_now, hn::Set(d, (float)n), lane_steps);
+                    escaped = hn::Or(escaped, esc_now);
+                    if (hn::AllFalse(d, hn::AndNot(escaped, all_lanes))) {
+                        running = false;
+                        break;
+                    }
+                }
+
+                auto twox = hn::Add(x_vec, x_vec);
+                y_vec = hn::MulAdd(twox, y_vec, cy_vec);
+                x_vec = hn::Add(hn::Sub(x2, y2), cx_vec);
+                steps = n + 1;
+
+                // periodic distance check, tolerance sized for float rounding
+                if (n > 50 && --cd == 0) {
+                    cd = 20;
+                    auto dx = hn::Sub(x_vec, oldx);
+                    auto dy = hn::Sub(y_vec, oldy);
+                    auto d2 = hn::MulAdd(dx, dx, hn::Mul(dy, dy));
+                    auto ref = hn::Mul(hn::Set(d, 1e-12f), hn::Add(mag2, vOne));
+                    auto periodic = hn::AndNot(escaped, hn::Lt(d2, ref));
+                    if (!hn::AllFalse(d, periodic)) {
+                        counts->periodic += (long long)hn::CountTrue(d, periodic);
+                        lane_steps = hn::IfThenElse(periodic, hn::Set(d, (float)steps), lane_steps);
+                        escaped = hn::Or(escaped, periodic);
+                    }
+                    if (hn::AllFalse(d, hn::AndNot(escaped, all_lanes))) {
+                        running = false;
+                        break;
+                    }
+                    oldx = x_vec;
+                    oldy = y_vec;
+                }
+            }
+            if (!running) {
+                break;
+            }
+
+            auto at_limit = hn::AndNot(escaped, hn::Ge(hn::Add(hn::Load(d, start_arr), hn::Set(d, (float)n)), vMax));
+            if (orbit_out) {
+                hn::Store(hn::IfThenElse(at_limit, x_vec, hn::Load(d, x_arr)), d, x_arr);
+                hn::Store(hn::IfThenElse(at_limit, y_vec, hn::Load(d, y_arr)), d, y_arr);
+                hn::Store(hn::IfThenElse(at_limit, oldx, hn::Load(d, oldx_arr)), d, oldx_arr);
+                hn::Store(hn::IfThenElse(at_limit, oldy, hn::Load(d, oldy_arr)), d, oldy_arr);
             }
-            continue;  // get next block of pixels
+            escaped = hn::Or(escaped, at_limit);
+            running = !hn::AllFalse(d, hn::AndNot(escaped, all_lanes));
+        }
+
+        hn::Store(escaped_iter, d, result_arr);
+        hn::Store(lane_steps, d, steps_arr);
+        for (int i = 0; i < lanes; i++) {
+            out_iterations[px + i] = (int)result_arr[i];
+            counts->iterations += (long long)steps_arr[i];
+            if (orbit_out && result_arr[i] == max_iterations) {
+                // below the limit when the lane was shown to be inside instead, as SimdRow saves them
+                OrbitState* orbit = &orbit_out[px + i];
+                orbit->cx = cx_arr[i];
+                orbit->x = x_arr[i];
+                orbit->y = y_arr[i];
+                orbit->oldx = oldx_arr[i];
+                orbit->oldy = oldy_arr[i];
+                orbit->iterations = (int)(start_arr[i] + steps_arr[i]);
+            }
+        }
+        counts->lane_steps += (long long)steps * N;
+    }
+}
+
+void SimdRowF32(double x0_start, double y0, double zoom, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations,
+                const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    SimdSpanF32<false>(x0_start, y0, 0, zoom, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out, counts);
+}
+
+void SimdColumnF32(double x0, double y_origin, int y_first, double zoom, int max_iterations, int* out_iterations, int pixel_count,
+                   bool no_optimisations, const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    SimdSpanF32<true>(x0, y_origin, y_first, zoom, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out,
+                      counts);
+}
+
+// double-double: value = hi + lo with |lo| <= ulp(hi) / 2, about 106 significant bits
+template <class V>
+struct DD {
+    V hi, lo;
+};
+
+// a + b exactly, as a rounded sum plus its rounding error
+template <class V>
+static HWY_INLINE DD<V> TwoSum(V a, V b) {
+    V s = hn::Add(a, b);
+    V bb = hn::Sub(s, a);
+    V e = hn::Add(hn::Sub(a, hn::Sub(s, bb)), hn::Sub(b, bb));
+    return {s, e};
+}
+
+// same, valid when |a| >= |b|
+template <class V>
+static HWY_INLINE DD<V> QuickTwoSum(V a, V b) {
+    V s = hn::Add(a, b);
+    return {s, hn::Sub(b, hn::Sub(s, a))};
+}
+
+// a * b exactly: a fused multiply-subtract returns the product's rounding error in one instruction,
+// targets without FMA fall back to Dekker's split into 26 bit halves
+template <class D, class V>
+static HWY_INLINE DD<V> TwoProd(D d, V a, V b) {
+    V p = hn::Mul(a, b);
+#if HWY_NATIVE_FMA
+    (void)d;
+    return {p, hn::MulSub(a, b, p)};
+#else
+    const V split = hn::Set(d, 134217729.0);  // 2^27 + 1
+    V ta = hn::Mul(split, a);
+    V a_hi = hn::Sub(ta, hn::Sub(ta, a));
+    V a_lo = hn::Sub(a, a_hi);
+    V tb = hn::Mul(split, b);
+    V b_hi = hn::Sub(tb, hn::Sub(tb, b));
+    V b_lo = hn::Sub(b, b_hi);
+    V e = hn::Sub(hn::Mul(a_hi, b_hi), p);
+    e = hn::Add(hn::Add(hn::Add(e, hn::Mul(a_hi, b_lo)), hn::Mul(a_lo, b_hi)), hn::Mul(a_lo, b_lo));
+    return {p, e};
+#endif
+}
+
+// the sums below drop the low parts' own rounding error, which costs relative accuracy only under
+// cancellation; iterates stay below |z| = 2, so the absolute error remains around 2^-104
+template <class V>
+static HWY_INLINE DD<V> DDAdd(DD<V> a, DD<V> b) {
+    DD<V> s = TwoSum(a.hi, b.hi);
+    return QuickTwoSum(s.hi, hn::Add(s.lo, hn::Add(a.lo, b.lo)));
+}
+
+template <class D, class V>
+static HWY_INLINE DD<V> DDMul(D d, DD<V> a, DD<V> b) {
+    DD<V> p = TwoProd(d, a.hi, b.hi);
+    V cross = hn::MulAdd(a.hi, b.lo, hn::Mul(a.lo, b.hi));
+    return QuickTwoSum(p.hi, hn::Add(p.lo, cross));
+}
+
+template <class D, class V>
+static HWY_INLINE DD<V> DDSqr(D d, DD<V> a) {
+    DD<V> p = TwoProd(d, a.hi, a.hi);
+    V cross = hn::Mul(hn::Add(a.hi, a.hi), a.lo);
+    return QuickTwoSum(p.hi, hn::Add(p.lo, cross));
+}
+
+// double-double lanes for zooms past plain doubles: roughly four times the arithmetic of SimdRow,
+// but no reference orbit and nothing to glitch
+// pixel c = (c_hi + c_lo) + offset + px * zoom; the offsets from the centre are only a few hundred
+// pixels, so they are formed in plain double and added to the full precision centre per lane
+// a column's pixels are at y offsets (y_first + px) * zoom from the centre and keep x_offset
+template <bool kColumn>
+static HWY_INLINE void SimdSpanDD(double cx_hi, double cx_lo, double x_offset, double cy_hi, double cy_lo, double y_offset, int y_first,
+                                  double zoom, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations,
+                                  IterationCounts* counts) {
+    const hn::ScalableTag<double> d;
+    using V = hn::Vec<decltype(d)>;
+    const int N = hn::Lanes(d);
+
+    const auto vFour = hn::Set(d, 4.0);
+    const auto vZero = hn::Zero(d);
+    const auto vMax = hn::Set(d, (double)max_iterations);
+    const auto all_lanes = hn::FirstN(d, N);
+    const DD<V> centre_x = {hn::Set(d, cx_hi), hn::Set(d, cx_lo)};
+    const DD<V> centre_y = {hn::Set(d, cy_hi), hn::Set(d, cy_lo)};
+
+    // orbits settle onto a cycle far more tightly than a pixel; the double kernels' fixed 1e-12 is
+    // coarser than a pixel here and would swallow slowly escaping points
+    const double eps = 1e-3 * zoom < 1e-12 ? 1e-3 * zoom : 1e-12;
+    const auto vEps2 = hn::Set(d, eps * eps);
+
+    HWY_ALIGN double offset_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double result_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double steps_arr[HWY_MAX_BYTES / sizeof(double)];
+
+    for (int px = 0; px < pixel_count; px += N) {
+        int lanes = pixel_count - px < N ? pixel_count - px : N;
+        for (int i = 0; i < N; i++) {
+            int lane = px + (i < lanes ? i : 0);
+            offset_arr[i] = kColumn ? (double)(y_first + lane) * zoom : x_offset + lane * zoom;
         }
+        const auto offset = DD<V>{hn::Load(d, offset_arr), vZero};
+        const DD<V> cx = DDAdd(centre_x, kColumn ? DD<V>{hn::Set(d, x_offset), vZero} : offset);
+        const DD<V> cy = DDAdd(centre_y, kColumn ? offset : DD<V>{hn::Set(d, y_offset), vZero});
 
-        auto oldx = hn::Zero(d);
-        auto oldy = hn::Zero(d);
+        auto escaped = hn::Not(hn::FirstN(d, lanes));
+        if (!no_optimisations) {
+            // on the high parts alone: rounding moves c by ~1e-16, where points near the boundary
+            // take far longer than any iteration limit to escape
+            auto cy2 = hn::Mul(cy.hi, cy.hi);
+            auto x1 = hn::Add(cx.hi, hn::Set(d, 1.0));
+            auto bulb = hn::Le(hn::MulAdd(x1, x1, cy2), hn::Set(d, 0.0625));
+            auto xm = hn::Sub(cx.hi, hn::Set(d, 0.25));
+            auto q = hn::MulAdd(xm, xm, cy2);
+            auto cardioid = hn::Le(hn::Mul(q, hn::Add(q, xm)), hn::Mul(hn::Set(d, 0.25), cy2));
+            auto inside = hn::And(hn::Or(bulb, cardioid), hn::FirstN(d, lanes));
+            counts->inside += (long long)hn::CountTrue(d, inside);
+            escaped = hn::Or(escaped, inside);
+        }
+
+        auto escaped_iter = vMax;
+        auto lane_steps = hn::IfThenZeroElse(escaped, vMax);  // see SimdRowF32
+        int steps = 0;
+        DD<V> x = {vZero, vZero};
+        DD<V> y = {vZero, vZero};
+        DD<V> old_x = x;
+        DD<V> old_y = y;
         int cd = 20;
 
-        for (int iter = 0; iter < max_iterations; iter++) {
-            auto x2 = hn::Mul(x_vec, x_vec);
-            auto y2 = hn::Mul(y_vec, y_vec);
-            auto mag2 = hn::Add(x2, y2);
+        int iter = hn::AllFalse(d, hn::AndNot(escaped, all_lanes)) ? max_iterations : 0;
+        for (; iter < max_iterations; iter++) {
+            DD<V> x2 = DDSqr(d, x);
+            DD<V> y2 = DDSqr(d, y);
+            auto mag2 = hn::Add(x2.hi, y2.hi);
 
-            // check escaped lanes
             auto esc_now = hn::AndNot(escaped, hn::Gt(mag2, vFour));
             if (!hn::AllFalse(d, esc_now)) {
                 escaped_iter = hn::IfThenElse(esc_now, hn::Set(d, (double)iter), escaped_iter);
+                lane_steps = hn::IfThenElse(esc_now, hn::Set(d, (double)iter), lane_steps);
                 escaped = hn::Or(escaped, esc_now);
                 if (hn::AllFalse(d, hn::AndNot(escaped, all_lanes))) {
                     break;
                 }
             }
 
-            // compute next iteration
-            // even on escaped lanes, avoiding additional conditional checks
-            auto twox = hn::Add(x_vec, x_vec);
-            y_vec = hn::MulAdd(twox, y_vec, vY0);
-            x_vec = hn::Add(hn::Sub(x2, y2), cx_vec);
+            // z = z^2 + c, doubling 2xy is exact
+            DD<V> xy = DDMul(d, x, y);
+            y = DDAdd(DD<V>{hn::Add(xy.hi, xy.hi), hn::Add(xy.lo, xy.lo)}, cy);
+            x = DDAdd(DDAdd(x2, DD<V>{hn::Neg(y2.hi), hn::Neg(y2.lo)}), cx);
+            steps = iter + 1;
 
-            // periodic distance check
             if (iter > 50 && --cd == 0) {
                 cd = 20;
-                auto not_esc = hn::AndNot(escaped, all_lanes);
-                if (!hn::AllFalse(d, not_esc)) {
-                    auto dx = hn::Sub(x_vec, oldx);
-                    auto dy = hn::Sub(y_vec, oldy);
-                    auto d2 = hn::Add(hn::Mul(dx, dx), hn::Mul(dy, dy));
-                    auto ref = hn::Mul(hn::Set(d, 1e-24), hn::Add(mag2, vOne));
-                    auto periodic = hn::And(not_esc, hn::Lt(d2, ref));
+                auto dx = hn::Add(hn::Sub(x.hi, old_x.hi), hn::Sub(x.lo, old_x.lo));
+                auto dy = hn::Add(hn::Sub(y.hi, old_y.hi), hn::Sub(y.lo, old_y.lo));
+                auto d2 = hn::MulAdd(dx, dx, hn::Mul(dy, dy));
+                auto periodic = hn::AndNot(escaped, hn::Lt(d2, vEps2));
+                if (!hn::AllFalse(d, periodic)) {
+                    counts->periodic += (long long)hn::CountTrue(d, periodic);
+                    lane_steps = hn::IfThenElse(periodic, hn::Set(d, (double)steps), lane_steps);
                     escaped = hn::Or(escaped, periodic);
                 }
-                oldx = x_vec;
-                oldy = y_vec;
+                if (hn::AllFalse(d, hn::AndNot(escaped, all_lanes))) {
+                    break;
+                }
+                old_x = x;
+                old_y = y;
             }
         }
 
         hn::Store(escaped_iter, d, result_arr);
+        hn::Store(lane_steps, d, steps_arr);
+        for (int i = 0; i < lanes; i++) {
+            out_iterations[px + i] = (int)result_arr[i];
+            counts->iterations += (long long)steps_arr[i];
+        }
+        counts->lane_steps += (long long)steps * N;
+    }
+}
+
+void SimdRowDD(double cx_hi, double cx_lo, double x_offset, double cy_hi, double cy_lo, double y_offset, double zoom, int max_iterations,
+               int* out_iterations, int pixel_count, bool no_optimisations, IterationCounts* counts) {
+    SimdSpanDD<false>(cx_hi, cx_lo, x_offset, cy_hi, cy_lo, y_offset, 0, zoom, max_iterations, out_iterations, pixel_count, no_optimisations,
+                      counts);
+}
+
+void SimdColumnDD(double cx_hi, double cx_lo, double x_offset, double cy_hi, double cy_lo, int y_first, double zoom, int max_iterations,
+                  int* out_iterations, int pixel_count, bool no_optimisations, IterationCounts* counts) {
+    SimdSpanDD<true>(cx_hi, cx_lo, x_offset, cy_hi, cy_lo, 0.0, y_first, zoom, max_iterations, out_iterations, pixel_count, no_optimisations,
+                     counts);
+}
+
+// perturbation: every lane follows the same reference orbit, so Z_n is a broadcast and only dz is per lane
+// dz' = (2Z + dz) dz + dc, escape on |Z + dz|^2 > 4, glitch when |Z + dz|^2 < glitch_bound[n]
+// a row's pixels are at dc = (deltas[px], fixed), a column's at (fixed, deltas[px])
+template <bool kColumn>
+static HWY_INLINE void PerturbSpan(const ReferenceOrbit* ref, const double* HWY_RESTRICT deltas, double fixed, int max_iterations,
+                                   int* out_iterations, unsigned char* glitched, int pixel_count, long long* skipped, IterationCounts* counts) {
+    const hn::ScalableTag<double> d;
+    const int N = hn::Lanes(d);
+    const int limit = ref->length < max_iterations ? ref->length : max_iterations;
+    const double* HWY_RESTRICT ref_zr = ref->zr;
+    const double* HWY_RESTRICT ref_zi = ref->zi;
+    const double* HWY_RESTRICT glitch_bound = ref->glitch_bound;
+
+    const auto vFour = hn::Set(d, 4.0);
+    const auto vFixed = hn::Set(d, fixed);
+    const auto vLimit = hn::Set(d, (double)limit);
+    const auto all_lanes = hn::FirstN(d, N);
+
+    HWY_ALIGN double result_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double glitch_arr[HWY_MAX_BYTES / sizeof(double)];
+
+    int px = 0;
+    for (; px + N <= pixel_count; px += N) {
+        const auto vDelta = hn::LoadU(d, deltas + px);
+        const auto vDcx = kColumn ? vFixed : vDelta;
+        const auto vDcy = kColumn ? vDelta : vFixed;
+        auto dzr = hn::Zero(d);
+        auto dzi = hn::Zero(d);
+
+        auto done = hn::Lt(dzr, dzr);  // all-false mask
+        auto glitch = done;
+        auto done_iter = vLimit;
+        int n = 0;
+        int jumped = 0;
+
+        // bilinear steps while they hold for every lane (see perturbation_pixel)
+        if (limit > 1) {
+            dzr = vDcx;
+            dzi = vDcy;
+            n = 1;
+            const BLAStep* step;
+            while ((step = perturbation_bla_lookup(ref, n, hn::ReduceMax(d, hn::MulAdd(dzr, dzr, hn::Mul(dzi, dzi))), limit)) != nullptr) {
+                const auto ar = hn::Set(d, step->ar);
+                const auto ai = hn::Set(d, step->ai);
+                const auto br = hn::Set(d, step->br);
+                const auto bi = hn::Set(d, step->bi);
+                auto next_r = hn::Add(hn::MulSub(ar, dzr, hn::Mul(ai, dzi)), hn::MulSub(br, vDcx, hn::Mul(bi, vDcy)));
+                dzi = hn::Add(hn::MulAdd(ar, dzi, hn::Mul(ai, dzr)), hn::MulAdd(br, vDcy, hn::Mul(bi, vDcx)));
+                dzr = next_r;
+                n += step->steps;
+            }
+            jumped = n - 1;
+            *skipped += (long long)jumped * N;
+        }
+
+        for (; n < limit; n++) {
+            const auto Zr = hn::Set(d, ref_zr[n]);
+            const auto Zi = hn::Set(d, ref_zi[n]);
+            auto zr = hn::Add(Zr, dzr);
+            auto zi = hn::Add(Zi, dzi);
+            auto mag2 = hn::MulAdd(zr, zr, hn::Mul(zi, zi));
+
+            auto esc_now = hn::AndNot(done, hn::Gt(mag2, vFour));
+            auto glitch_now = hn::AndNot(done, hn::Lt(mag2, hn::Set(d, glitch_bound[n])));
+            auto stop = hn::Or(esc_now, glitch_now);
+            if (!hn::AllFalse(d, stop)) {
+                done_iter = hn::IfThenElse(stop, hn::Set(d, (double)n), done_iter);
+                glitch = hn::Or(glitch, glitch_now);
+                done = hn::Or(done, stop);
+                if (hn::AllFalse(d, hn::AndNot(done, all_lanes))) {
+                    break;
+                }
+            }
+
+            // finished lanes keep iterating, their result is already latched
+            auto tr = hn::Add(hn::Add(Zr, Zr), dzr);
+            auto ti = hn::Add(hn::Add(Zi, Zi), dzi);
+            auto next_r = hn::Add(hn::MulSub(tr, dzr, hn::Mul(ti, dzi)), vDcx);
+            dzi = hn::Add(hn::MulAdd(tr, dzi, hn::Mul(ti, dzr)), vDcy);
+            dzr = next_r;
+        }
+
+        // lanes still bounded when a short reference ran out need a reference of their own
+        if (limit < max_iterations) {
+            glitch = hn::Or(glitch, hn::AndNot(done, all_lanes));
+        }
+
+        // as perturbation_pixel counts them, each lane's steps past the bilinear ones
+        hn::Store(done_iter, d, result_arr);
+        hn::Store(hn::IfThenElseZero(glitch, hn::Set(d, 1.0)), d, glitch_arr);
+        for (int i = 0; i < N; i++) {
+            out_iterations[px + i] = (int)result_arr[i];
+            glitched[px + i] = glitch_arr[i] != 0.0;
+            counts->iterations += (long long)result_arr[i] - jumped;
+        }
+        counts->lane_steps += (long long)(n - jumped) * N;
+    }
+
+    for (; px < pixel_count; px++) {
+        double dcx = kColumn ? fixed : deltas[px];
+        double dcy = kColumn ? deltas[px] : fixed;
+        out_iterations[px] = perturbation_pixel(ref, dcx, dcy, max_iterations, &glitched[px], skipped, counts);
+    }
+}
+
+void PerturbRow(const ReferenceOrbit* ref, const double* HWY_RESTRICT dcx, double dcy, int max_iterations, int* out_iterations,
+                unsigned char* glitched, int pixel_count, long long* skipped, IterationCounts* counts) {
+    PerturbSpan<false>(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, skipped, counts);
+}
+
+void PerturbColumn(const ReferenceOrbit* ref, double dcx, const double* HWY_RESTRICT dcy, int max_iterations, int* out_iterations,
+                   unsigned char* glitched, int pixel_count, long long* skipped, IterationCounts* counts) {
+    PerturbSpan<true>(ref, dcy, dcx, max_iterations, out_iterations, glitched, pixel_count, skipped, counts);
+}
+
+// one row of a zoomed frame resampled from the last one: pixel px takes the nearest source pixel to
+// src_x0 + px * scale (in source pixels). see mandelbrot_simd_reproject_row() for the outputs
+void ReprojectRow(const int* HWY_RESTRICT src_row, int src_width, double src_x0, double scale, bool row_exact, int max_iterations,
+                  int exact_limit, int* out_iterations, unsigned char* exact, int pixel_count) {
+    const hn::ScalableTag<double> d;
+    const hn::Rebind<int32_t, decltype(d)> di;
+    const int N = hn::Lanes(d);
+
+    const auto vX0 = hn::Set(d, src_x0);
+    const auto vScale = hn::Set(d, scale);
+    const auto vWidth = hn::Set(d, (double)src_width);
+    const auto vTolerance = hn::Set(d, REPROJECT_TOLERANCE);
+    const auto vMax = hn::Set(d, (double)max_iterations);
+    const auto vLimit = hn::Set(d, (double)exact_limit);
+    const auto vNone = hn::Set(d, -1.0);
+    const auto vZero = hn::Zero(d);
+    const auto row_mask = row_exact ? hn::Eq(vZero, vZero) : hn::Lt(vZero, vZero);
+
+    HWY_ALIGN double result_arr[HWY_MAX_BYTES / sizeof(double)];
+    HWY_ALIGN double exact_arr[HWY_MAX_BYTES / sizeof(double)];
+
+    int px = 0;
+    for (; px + N <= pixel_count; px += N) {
+        const auto sx = hn::MulAdd(hn::Iota(d, (double)px), vScale, vX0);
+        const auto rx = hn::Round(sx);
+        auto inside = hn::And(hn::Ge(rx, vZero), hn::Lt(rx, vWidth));
+
+        // lanes outside the source read its first pixel and are discarded
+        const auto index = hn::DemoteTo(di, hn::IfThenElseZero(inside, rx));
+        const auto count = hn::PromoteTo(d, hn::GatherIndex(di, src_row, index));
+        inside = hn::And(inside, hn::Ge(count, vZero));
+
+        auto on_sample = hn::And(row_mask, hn::Le(hn::Abs(hn::Sub(sx, rx)), vTolerance));
+        auto same = hn::And(hn::And(inside, on_sample), hn::Lt(count, vLimit));
+
+        hn::Store(hn::IfThenElse(inside, hn::Min(count, vMax), vNone), d, result_arr);
+        hn::Store(hn::IfThenElseZero(same, hn::Set(d, 1.0)), d, exact_arr);
         for (int i = 0; i < N; i++) {
             out_iterations[px + i] = (int)result_arr[i];
+            exact[px + i] = exact_arr[i] != 0.0;
         }
     }
 
-    // remaining pixels in row completed with scalar function
     for (; px < pixel_count; px++) {
-        double cx = x0_start + px * zoom;
-        out_iterations[px] = calculateMandelbrotOpts(cx, y0, max_iterations, no_optimisations);
+        double sx = src_x0 + px * scale;
+        double rx = nearbyint(sx);
+        int count = rx >= 0.0 && rx < src_width ? src_row[(int)rx] : -1;
+        out_iterations[px] = count < 0 ? -1 : count < max_iterations ? count : max_iterations;
+        exact[px] = count >= 0 && row_exact && fabs(sx - rx) <= REPROJECT_TOLERANCE && count < exact_limit;
+    }
+}
+
+// palette colours for a row of iteration counts, the same mapping as iterationColour() in mandelbrot.c
+// the divisions are reciprocal multiplies: adding half before flooring keeps exact quotients from rounding
+// down, and no inexact one is within half of 1 / divisor of the next integer
+void ColourRow(const int* HWY_RESTRICT iterations, int count, int max_iterations, const uint32_t* HWY_RESTRICT palette, int palette_size,
+               bool smooth, int palette_scale, uint32_t* HWY_RESTRICT out) {
+    const hn::ScalableTag<double> d;
+    const hn::Rebind<int32_t, decltype(d)> di;
+    const hn::Rebind<uint32_t, decltype(d)> du;
+    const int N = hn::Lanes(d);
+
+    const auto vZero = hn::Zero(d);
+    const auto vHalf = hn::Set(d, 0.5);
+    const auto vMax = hn::Set(d, (double)max_iterations);
+    const auto vSize = hn::Set(d, (double)palette_size);
+    const auto vInvSize = hn::Set(d, 1.0 / palette_size);
+    const auto vScale = hn::Set(d, (double)palette_scale);
+    const auto vBand = hn::Set(d, (double)(palette_size - 1));
+    const auto vInvMax = hn::Set(d, 1.0 / max_iterations);
+    const auto vFrequency = hn::Set(d, 10.0);
+
+    for (int px = 0; px < count; px += N) {
+        const size_t lanes = count - px < N ? count - px : N;
+        const auto iter = hn::PromoteTo(d, hn::LoadN(di, iterations + px, lanes));
+
+        hn::Vec<decltype(d)> index;
+        if (smooth) {
+            // every 10th palette entry per iteration, wrapping; the inside and counts past the palette get entry 0
+            const auto n = hn::Mul(iter, vFrequency);
+            const auto wrapped = hn::NegMulAdd(hn::Floor(hn::Mul(hn::Add(n, vHalf), vInvSize)), vSize, n);
+            const auto first = hn::Or(hn::Eq(iter, vMax), hn::Ge(hn::Mul(iter, vScale), vSize));
+            index = hn::IfThenZeroElse(first, wrapped);
+        } else {
+            const auto banded = hn::IfThenZeroElse(hn::Ge(iter, vMax), iter);
+            index = hn::Floor(hn::Mul(hn::MulAdd(banded, vBand, vHalf), vInvMax));
+        }
+        index = hn::Max(index, vZero);
+
+        const auto colour = hn::GatherIndex(du, palette, hn::DemoteTo(di, index));
+        hn::StoreN(colour, du, out + px, lanes);
+    }
+}
+
+// paint span pixels of a row from one colour per sample: pixel j is sample j >> step_shift's, where
+// (j & (step - 1)) < frac, and only where kind (if given) is REPROJECT_NONE
+void PaintRow(const uint32_t* HWY_RESTRICT colours, int step_shift, int frac, const unsigned char* HWY_RESTRICT kind, int span,
+              uint32_t* HWY_RESTRICT dst) {
+    const hn::ScalableTag<int32_t> di;
+    const hn::RebindToUnsigned<decltype(di)> du;
+    const hn::Rebind<uint8_t, decltype(di)> d8;
+    const int N = hn::Lanes(di);
+
+    const auto vStepMask = hn::Set(di, (1 << step_shift) - 1);
+    const auto vFrac = hn::Set(di, frac);
+    const auto vNone = hn::Set(du, (uint32_t)REPROJECT_NONE);
+
+    for (int j = 0; j < span; j += N) {
+        const size_t lanes = span - j < N ? span - j : N;
+        const auto pixel = hn::Iota(di, j);
+        auto covered = hn::And(hn::Lt(hn::And(pixel, vStepMask), vFrac), hn::FirstN(di, lanes));
+        if (kind) {
+            const auto shown = hn::PromoteTo(du, hn::LoadN(d8, kind + j, lanes));
+            covered = hn::And(covered, hn::RebindMask(di, hn::Eq(shown, vNone)));
+        }
+
+        // lanes left alone read the first colour
+        const auto sample = hn::IfThenElseZero(covered, hn::ShiftRightSame(pixel, step_shift));
+        const auto colour = hn::GatherIndex(du, colours, sample);
+        hn::BlendedStore(colour, hn::RebindMask(du, covered), du, dst + j);
     }
 }
 
@@ -150,11 +912,79 @@ HWY_AFTER_NAMESPACE();
 #if HWY_ONCE
 
 #include <stdio.h>
+#include <string.h>
 namespace mandelbrot_hwy {
 HWY_EXPORT(SimdRow);
+HWY_EXPORT(SimdRowF32);
+HWY_EXPORT(SimdRowDD);
+HWY_EXPORT(PerturbRow);
+HWY_EXPORT(SimdColumn);
+HWY_EXPORT(SimdColumnF32);
+HWY_EXPORT(SimdColumnDD);
+HWY_EXPORT(PerturbColumn);
+HWY_EXPORT(ReprojectRow);
+HWY_EXPORT(ColourRow);
+HWY_EXPORT(PaintRow);
 
-void CallSimdRow(double x0_start, double y0, double zoom_step, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations) {
-    HWY_DYNAMIC_DISPATCH(SimdRow)(x0_start, y0, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations);
+void CallSimdRow(double x0_start, double y0, double zoom_step, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations,
+                 const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(SimdRow)(x0_start, y0, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out,
+                                  counts);
+}
+
+void CallSimdRowF32(double x0_start, double y0, double zoom_step, int max_iterations, int* out_iterations, int pixel_count, bool no_optimisations,
+                    const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(SimdRowF32)(x0_start, y0, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out,
+                                     counts);
+}
+
+void CallSimdRowDD(double cx_hi, double cx_lo, double x_offset, double cy_hi, double cy_lo, double y_offset, double zoom_step, int max_iterations,
+                   int* out_iterations, int pixel_count, bool no_optimisations, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(SimdRowDD)(cx_hi, cx_lo, x_offset, cy_hi, cy_lo, y_offset, zoom_step, max_iterations, out_iterations, pixel_count,
+                                    no_optimisations, counts);
+}
+
+void CallPerturbRow(const ReferenceOrbit* ref, const double* dcx, double dcy, int max_iterations, int* out_iterations, unsigned char* glitched,
+                    int pixel_count, long long* skipped, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(PerturbRow)(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, skipped, counts);
+}
+
+void CallSimdColumn(double x0, double y_origin, int y_first, double zoom_step, int max_iterations, int* out_iterations, int pixel_count,
+                    bool no_optimisations, const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(SimdColumn)(x0, y_origin, y_first, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in,
+                                     orbit_out, counts);
+}
+
+void CallSimdColumnF32(double x0, double y_origin, int y_first, double zoom_step, int max_iterations, int* out_iterations, int pixel_count,
+                       bool no_optimisations, const OrbitState* orbit_in, OrbitState* orbit_out, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(SimdColumnF32)(x0, y_origin, y_first, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in,
+                                        orbit_out, counts);
+}
+
+void CallSimdColumnDD(double cx_hi, double cx_lo, double x_offset, double cy_hi, double cy_lo, int y_first, double zoom_step, int max_iterations,
+                      int* out_iterations, int pixel_count, bool no_optimisations, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(SimdColumnDD)(cx_hi, cx_lo, x_offset, cy_hi, cy_lo, y_first, zoom_step, max_iterations, out_iterations, pixel_count,
+                                       no_optimisations, counts);
+}
+
+void CallPerturbColumn(const ReferenceOrbit* ref, double dcx, const double* dcy, int max_iterations, int* out_iterations, unsigned char* glitched,
+                       int pixel_count, long long* skipped, IterationCounts* counts) {
+    HWY_DYNAMIC_DISPATCH(PerturbColumn)(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, skipped, counts);
+}
+
+void CallReprojectRow(const int* src_row, int src_width, double src_x0, double scale, bool row_exact, int max_iterations, int exact_limit,
+                      int* out_iterations, unsigned char* exact, int pixel_count) {
+    HWY_DYNAMIC_DISPATCH(ReprojectRow)(src_row, src_width, src_x0, scale, row_exact, max_iterations, exact_limit, out_iterations, exact,
+                                       pixel_count);
+}
+
+void CallColourRow(const int* iterations, int count, int max_iterations, const uint32_t* palette, int palette_size, bool smooth,
+                   int palette_scale, uint32_t* out) {
+    HWY_DYNAMIC_DISPATCH(ColourRow)(iterations, count, max_iterations, palette, palette_size, smooth, palette_scale, out);
+}
+
+void CallPaintRow(const uint32_t* colours, int step_shift, int frac, const unsigned char* kind, int span, uint32_t* dst) {
+    HWY_DYNAMIC_DISPATCH(PaintRow)(colours, step_shift, frac, kind, span, dst);
 }
 }
 
@@ -168,6 +998,51 @@ extern "C" void mandelbrot_simd_print_targets(void) {
     }
 }
 
+// compiled targets the CPU can run, lower bits are the better targets
+static int64_t RunnableTargets() {
+    return hwy::SupportedTargets() & HWY_TARGETS;
+}
+
+// the target picked by mandelbrot_simd_set_target(), 0 while dispatch picks the best
+static int64_t forced_target = 0;
+
+extern "C" const char* mandelbrot_simd_target(void) {
+    int64_t available = forced_target ? forced_target : RunnableTargets();
+    return hwy::TargetName(available & -available);
+}
+
+extern "C" int mandelbrot_simd_targets(const char** names, int max) {
+    int count = 0;
+    for (int64_t t = 1; t != 0; t <<= 1) {
+        if (RunnableTargets() & t) {
+            if (count < max) {
+                names[count] = hwy::TargetName(t);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+// dynamic dispatch calls through the export table entry for the best bit set in the chosen target mask;
+// ChosenTarget::Update() is Highway's runtime hook for narrowing that mask and leaves SupportedTargets() alone
+extern "C" bool mandelbrot_simd_set_target(const char* name) {
+    int64_t runnable = RunnableTargets();
+    if (!name) {
+        forced_target = 0;
+        hwy::GetChosenTarget().Update(runnable);
+        return true;
+    }
+    for (int64_t t = 1; t != 0; t <<= 1) {
+        if ((runnable & t) && strcmp(hwy::TargetName(t), name) == 0) {
+            forced_target = t;
+            hwy::GetChosenTarget().Update(t);
+            return true;
+        }
+    }
+    return false;
+}
+
 extern "C" void mandelbrot_simd_row(
     double x0_start,
     double y0,
@@ -175,8 +1050,156 @@ extern "C" void mandelbrot_simd_row(
     int max_iterations,
     int* out_iterations,
     int pixel_count,
-    bool no_optimisations) {
-    mandelbrot_hwy::CallSimdRow(x0_start, y0, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations);
+    bool no_optimisations,
+    const OrbitState* orbit_in,
+    OrbitState* orbit_out,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallSimdRow(x0_start, y0, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out,
+                                counts);
+}
+
+extern "C" void mandelbrot_simd_row_f32(
+    double x0_start,
+    double y0,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    const OrbitState* orbit_in,
+    OrbitState* orbit_out,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallSimdRowF32(x0_start, y0, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in, orbit_out,
+                                   counts);
+}
+
+extern "C" void mandelbrot_simd_row_dd(
+    double cx_hi,
+    double cx_lo,
+    double x_offset,
+    double cy_hi,
+    double cy_lo,
+    double y_offset,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallSimdRowDD(cx_hi, cx_lo, x_offset, cy_hi, cy_lo, y_offset, zoom_step, max_iterations, out_iterations, pixel_count,
+                                  no_optimisations, counts);
+}
+
+extern "C" void mandelbrot_simd_perturb_row(
+    const ReferenceOrbit* ref,
+    const double* dcx,
+    double dcy,
+    int max_iterations,
+    int* out_iterations,
+    unsigned char* glitched,
+    int pixel_count,
+    long long* skipped,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallPerturbRow(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, skipped, counts);
+}
+
+extern "C" void mandelbrot_simd_column(
+    double x0,
+    double y_origin,
+    int y_first,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    const OrbitState* orbit_in,
+    OrbitState* orbit_out,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallSimdColumn(x0, y_origin, y_first, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in,
+                                   orbit_out, counts);
+}
+
+extern "C" void mandelbrot_simd_column_f32(
+    double x0,
+    double y_origin,
+    int y_first,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    const OrbitState* orbit_in,
+    OrbitState* orbit_out,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallSimdColumnF32(x0, y_origin, y_first, zoom_step, max_iterations, out_iterations, pixel_count, no_optimisations, orbit_in,
+                                      orbit_out, counts);
+}
+
+extern "C" void mandelbrot_simd_column_dd(
+    double cx_hi,
+    double cx_lo,
+    double x_offset,
+    double cy_hi,
+    double cy_lo,
+    int y_first,
+    double zoom_step,
+    int max_iterations,
+    int* out_iterations,
+    int pixel_count,
+    bool no_optimisations,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallSimdColumnDD(cx_hi, cx_lo, x_offset, cy_hi, cy_lo, y_first, zoom_step, max_iterations, out_iterations, pixel_count,
+                                     no_optimisations, counts);
+}
+
+extern "C" void mandelbrot_simd_perturb_column(
+    const ReferenceOrbit* ref,
+    double dcx,
+    const double* dcy,
+    int max_iterations,
+    int* out_iterations,
+    unsigned char* glitched,
+    int pixel_count,
+    long long* skipped,
+    IterationCounts* counts) {
+    mandelbrot_hwy::CallPerturbColumn(ref, dcx, dcy, max_iterations, out_iterations, glitched, pixel_count, skipped, counts);
+}
+
+extern "C" void mandelbrot_simd_reproject_row(
+    const int* src_row,
+    int src_width,
+    double src_x0,
+    double scale,
+    bool row_exact,
+    int max_iterations,
+    int exact_limit,
+    int* out_iterations,
+    unsigned char* exact,
+    int pixel_count) {
+    mandelbrot_hwy::CallReprojectRow(src_row, src_width, src_x0, scale, row_exact, max_iterations, exact_limit, out_iterations, exact,
+                                     pixel_count);
+}
+
+extern "C" void mandelbrot_simd_colour_row(
+    const int* iterations,
+    int count,
+    int max_iterations,
+    const uint32_t* palette,
+    int palette_size,
+    bool smooth,
+    int palette_scale,
+    uint32_t* out) {
+    mandelbrot_hwy::CallColourRow(iterations, count, max_iterations, palette, palette_size, smooth, palette_scale, out);
+}
+
+extern "C" void mandelbrot_simd_paint_row(
+    const uint32_t* colours,
+    int step_shift,
+    int frac,
+    const unsigned char* kind,
+    int span,
+    uint32_t* dst) {
+    mandelbrot_hwy::CallPaintRow(colours, step_shift, frac, kind, span, dst);
 }
 
 #endif
\ No newline at end of file
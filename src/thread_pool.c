@@ -0,0 +1,1033 @@
+#ifdef _WIN32  // predefined in vs2022 stdlib
+#define HAVE_STRUCT_TIMESPEC
+#endif
+#include "thread_pool.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// saved orbits are capped at this much memory, over a third of a 1280x720 screen
+#define ORBIT_STORE_BYTES (16 * 1024 * 1024)
+
+static double elapsed_ms(struct timespec* t0, struct timespec* t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1000.0 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+// cut the screen into tiles, or one band per thread when tile_size is 0
+static int build_tiles(struct ThreadPool* tp, int scrn_width, int scrn_height) {
+    if (tp->tile_size <= 0) {
+        int bands = (int)tp->count > scrn_height ? scrn_height : (int)tp->count;
+        int rows_per_band = scrn_height / bands;
+
+        tp->tiles = calloc(bands, sizeof(struct RenderTile));
+        if (!tp->tiles) {
+            return 1;
+        }
+        for (int i = 0; i < bands; i++) {
+            tp->tiles[i].start_x = 0;
+            tp->tiles[i].end_x = scrn_width;
+            tp->tiles[i].start_y = i * rows_per_band;
+            tp->tiles[i].end_y = (i == bands - 1) ? scrn_height : (i + 1) * rows_per_band;
+        }
+        tp->tile_count = bands;
+        return 0;
+    }
+
+    // tiles stay aligned to the coarsest render fraction so every pass samples the same grid
+    tp->tile_size = (tp->tile_size + 7) & ~7;
+    int tiles_x = (scrn_width + tp->tile_size - 1) / tp->tile_size;
+    int tiles_y = (scrn_height + tp->tile_size - 1) / tp->tile_size;
+
+    tp->tiles = calloc(tiles_x * tiles_y, sizeof(struct RenderTile));
+    if (!tp->tiles) {
+        return 1;
+    }
+
+    int t = 0;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++, t++) {
+            tp->tiles[t].start_x = tx * tp->tile_size;
+            tp->tiles[t].end_x = (tx == tiles_x - 1) ? scrn_width : (tx + 1) * tp->tile_size;
+            tp->tiles[t].start_y = ty * tp->tile_size;
+            tp->tiles[t].end_y = (ty == tiles_y - 1) ? scrn_height : (ty + 1) * tp->tile_size;
+        }
+    }
+    tp->tile_count = t;
+    return 0;
+}
+
+// tiles a pan or a mirrored frame queues at most: one per chunk of the screen for a pan, two full width strips
+// cut into chunks for a mirror, or one band per thread for a mirror in band mode
+static int pan_tile_capacity(struct ThreadPool* tp, int scrn_width, int scrn_height) {
+    int chunk = tp->tile_size > 0 ? tp->tile_size : DEFAULT_TILE_SIZE;
+    int capacity = 2 * ((scrn_width + chunk - 1) / chunk) * ((scrn_height + chunk - 1) / chunk);
+    return capacity > (int)tp->count ? capacity : (int)tp->count;
+}
+
+static void add_pan_rect(struct ThreadPool* tp, int start_x, int end_x, int start_y, int end_y) {
+    int chunk = tp->tile_size > 0 ? tp->tile_size : DEFAULT_TILE_SIZE;
+    for (int y = start_y; y < end_y; y += chunk) {
+        for (int x = start_x; x < end_x; x += chunk) {
+            struct RenderTile* t = &tp->pan_tiles[tp->pan_tile_count++];
+            t->start_x = x;
+            t->end_x = x + chunk < end_x ? x + chunk : end_x;
+            t->start_y = y;
+            t->end_y = y + chunk < end_y ? y + chunk : end_y;
+        }
+    }
+}
+
+// rows start_y to end_y cut into full width bands of whole render fractions, for band mode
+static void add_pan_bands(struct ThreadPool* tp, int width, int start_y, int end_y, int bands) {
+    int blocks = (end_y - start_y + 7) / 8;
+    if (bands > blocks) {
+        bands = blocks;
+    }
+    for (int i = 0; i < bands; i++) {
+        struct RenderTile* t = &tp->pan_tiles[tp->pan_tile_count++];
+        t->start_x = 0;
+        t->end_x = width;
+        t->start_y = start_y + 8 * (i * blocks / bands);
+        t->end_y = i == bands - 1 ? end_y : start_y + 8 * ((i + 1) * blocks / bands);
+    }
+}
+
+// the pending frame has the last frame's screen and options, finished or not
+static bool compatible(struct ThreadPool* tp) {
+    const struct RenderJob* a = &tp->frame;
+    const struct RenderJob* b = &tp->pending;
+    return tp->running_generation != 0 && !tp->forget_frame && a->use_simd == b->use_simd &&
+           a->no_optimisations == b->no_optimisations && a->mariani_silver == b->mariani_silver && a->solid_guess == b->solid_guess &&
+           tp->frame_vp.screen_width == tp->pending_vp.screen_width && tp->frame_vp.screen_height == tp->pending_vp.screen_height;
+}
+
+// ... and the last frame finished, so its iteration counts can seed the pending one; every use of them colours
+// the pixels it reuses again, so it may draw into another buffer
+static bool reusable(struct ThreadPool* tp) {
+    return tp->counts_final && compatible(tp);
+}
+
+// ... and the colours it left in the buffer too; the running frame's budget already has its default filled in
+static bool same_colours(struct ThreadPool* tp) {
+    const struct RenderJob* a = &tp->frame;
+    const struct RenderJob* b = &tp->pending;
+    int budget = b->aa_budget > 0 ? b->aa_budget : tp->pending_vp.screen_width * tp->pending_vp.screen_height;
+    return a->palette == b->palette && a->palette_size == b->palette_size && a->palette_version == b->palette_version &&
+           a->render_smooth == b->render_smooth && a->aa_samples == b->aa_samples && a->aa_budget == budget;
+}
+
+// the pending frame computes the count the last frame did for every pixel they share
+static bool same_arithmetic(struct ThreadPool* tp) {
+    const struct viewport* va = &tp->frame_vp;
+    const struct viewport* vb = &tp->pending_vp;
+    return tp->frame.precision == tp->pending.precision && va->zoom == vb->zoom && va->iterations == vb->iterations;
+}
+
+// ... and the last frame finished, so each pixel only needs a new colour
+static bool same_counts(struct ThreadPool* tp) {
+    return reusable(tp) && same_arithmetic(tp);
+}
+
+// pending frame's centre minus the finished frame's, in the finished frame's pixels
+static void centre_shift(struct ThreadPool* tp, double* dx, double* dy) {
+    struct apfloat delta;
+    ap_sub(&delta, &tp->pending_vp.centre_x, &tp->frame_vp.centre_x);
+    *dx = ap_to_double(&delta) / tp->frame_vp.zoom;
+    ap_sub(&delta, &tp->pending_vp.centre_y, &tp->frame_vp.centre_y);
+    *dy = ap_to_double(&delta) / tp->frame_vp.zoom;
+}
+
+// a palette or shading change with the view left alone
+static bool recolour_only(struct ThreadPool* tp) {
+    if (!tp->pending.recolour || !same_counts(tp)) {
+        return false;
+    }
+    double dx, dy;
+    centre_shift(tp, &dx, &dy);
+    return dx == 0.0 && dy == 0.0;
+}
+
+// another sample of every pixel of the finished frame, nothing about it changed; the sample before it finished
+static bool accumulate_only(struct ThreadPool* tp) {
+    if (tp->pending.accum_sample <= 0 || !tp->pending.accum || !same_counts(tp) || !same_colours(tp) ||
+        tp->frame.buffer != tp->pending.buffer) {
+        return false;
+    }
+    double dx, dy;
+    centre_shift(tp, &dx, &dy);
+    return dx == 0.0 && dy == 0.0;
+}
+
+// a higher iteration limit with the view and arithmetic left alone; deep frames would need their reference
+// orbit extended first, so they render again
+static bool raise_only(struct ThreadPool* tp) {
+    const struct viewport* va = &tp->frame_vp;
+    const struct viewport* vb = &tp->pending_vp;
+    if (!reusable(tp) || tp->frame.precision != tp->pending.precision || tp->pending.precision == PRECISION_PERTURBATION ||
+        va->zoom != vb->zoom || vb->iterations <= va->iterations) {
+        return false;
+    }
+    double dx, dy;
+    centre_shift(tp, &dx, &dy);
+    return dx == 0.0 && dy == 0.0;
+}
+
+// forget the saved orbits, for a frame that iterates its pixels afresh
+static void reset_orbits(struct ThreadPool* tp) {
+    memset(tp->orbits.slot, 0xff, (size_t)tp->frame_vp.screen_width * tp->frame_vp.screen_height * sizeof(int));  // ORBIT_NONE
+    tp->orbits.used = 0;
+}
+
+// whole pixel offset of the pending frame's centre from the last frame's, when nothing else about them differs,
+// not even the buffer; the last frame's buffers then hold every pixel it finished (see final_pixels) that the pan
+// keeps on screen, whether or not the frame itself was cut short
+static bool pan_offset(struct ThreadPool* tp, int* shift_x, int* shift_y) {
+    if (!compatible(tp) || !same_arithmetic(tp) || !same_colours(tp) || tp->frame.buffer != tp->pending.buffer) {
+        return false;
+    }
+
+    double dx, dy;
+    centre_shift(tp, &dx, &dy);
+    double rx = round(dx), ry = round(dy);
+    if (fabs(dx - rx) > 1e-6 || fabs(dy - ry) > 1e-6 || (rx == 0.0 && ry == 0.0) || fabs(rx) >= tp->pending_vp.screen_width ||
+        fabs(ry) >= tp->pending_vp.screen_height) {
+        return false;
+    }
+    *shift_x = (int)rx;
+    *shift_y = (int)ry;
+    return true;
+}
+
+// rows the frame can copy from their reflection in the real axis, clipped to the coarsest render fraction so the
+// rows left keep the full frame's sampling grid. pixel y lies at offset_y + (y - h) * zoom, so it mirrors row
+// 2h - 2 offset_y / zoom - y, which must be a whole row; perturbation's reference orbit isn't symmetric
+static void start_mirror(struct ThreadPool* tp) {
+    const struct viewport* vp = &tp->frame_vp;
+    tp->mirror_start = tp->mirror_end = 0;
+    if (tp->frame.precision == PRECISION_PERTURBATION) {
+        return;
+    }
+
+    double shift = 2.0 * ap_to_double(&vp->centre_y) / vp->zoom;
+    double rounded = round(shift);
+    int height = vp->screen_height;
+    if (fabs(shift - rounded) > 1e-6 || fabs(rounded) >= 2.0 * height) {
+        return;
+    }
+    int axis = 2 * (height / 2) - (int)rounded;
+
+    // the lower row of each pair is copied
+    int start = axis < 0 ? 0 : axis / 2 + 1;
+    int end = axis + 1 < height ? axis + 1 : height;
+    start = (start + 7) & ~7;
+    end = end == height ? height : end & ~7;
+    if (end - start < 8) {
+        return;
+    }
+
+    tp->mirror_axis = axis;
+    tp->mirror_start = start;
+    tp->mirror_end = end;
+    tp->pan_tile_count = 0;
+    if (tp->tile_size > 0) {
+        add_pan_rect(tp, 0, vp->screen_width, 0, start);
+        add_pan_rect(tp, 0, vp->screen_width, end, height);
+    } else {
+        // still one static band per thread, shared between the strips by their height; a single thread takes both
+        int threads = (int)tp->count;
+        int top = (int)((long long)threads * start / (start + height - end));
+        if (end < height && top > threads - 1) {
+            top = threads - 1;
+        }
+        if (start > 0 && top < 1) {
+            top = 1;
+        }
+        int bottom = threads - top < 1 ? 1 : threads - top;
+        add_pan_bands(tp, vp->screen_width, 0, start, top);
+        add_pan_bands(tp, vp->screen_width, end, height, end < height ? bottom : 0);
+    }
+    tp->frame_tiles = tp->pan_tiles;
+    tp->frame_tile_count = tp->pan_tile_count;
+}
+
+// the tile's pixels (and the rows mirrored from it) hold their final count and colour; called with the lock held
+static void mark_final(struct ThreadPool* tp, const struct RenderTile* tile) {
+    int width = tp->frame_vp.screen_width;
+    size_t count = (size_t)(tile->end_x - tile->start_x);
+    for (int y = tile->start_y; y < tile->end_y; y++) {
+        memset(tp->final_pixels + (size_t)y * width + tile->start_x, 1, count);
+        int m = tp->mirror_axis - y;
+        if (tp->mirror_end > tp->mirror_start && m >= tp->mirror_start && m < tp->mirror_end) {
+            memset(tp->final_pixels + (size_t)m * width + tile->start_x, 1, count);
+        }
+    }
+}
+
+// the frame has finished, so every pixel on screen has its final count and colour
+static void mark_counts_final(struct ThreadPool* tp) {
+    tp->counts_final = true;
+    memset(tp->final_pixels, 1, (size_t)tp->frame_vp.screen_width * tp->frame_vp.screen_height);
+}
+
+// copy the rows of a finished tile that mirror rows left out of the frame's tiles
+static void mirror_tile(struct ThreadPool* tp, const struct RenderTile* tile) {
+    int width = tp->frame_vp.screen_width;
+    size_t count = (size_t)(tile->end_x - tile->start_x);
+    for (int y = tile->start_y; y < tile->end_y; y++) {
+        int m = tp->mirror_axis - y;
+        if (m < tp->mirror_start || m >= tp->mirror_end) {
+            continue;
+        }
+        size_t from = (size_t)y * width + tile->start_x;
+        size_t to = (size_t)m * width + tile->start_x;
+        memcpy(tp->frame.buffer + to, tp->frame.buffer + from, count * sizeof(Uint32));
+        memcpy(tp->iterations + to, tp->iterations + from, count * sizeof(int));
+    }
+}
+
+// move a grid of cells so that (x, y) holds what was at (x + dx, y + dy); cells with no source keep stale values
+static void shift_grid(void* grid, size_t cell, int width, int height, int dx, int dy) {
+    int first_x = dx < 0 ? -dx : 0;
+    size_t row_bytes = (size_t)(width - abs(dx)) * cell;
+    char* base = grid;
+
+    for (int i = 0; i < height - abs(dy); i++) {
+        // walk away from the rows being read so none is overwritten before it is copied
+        int y = dy < 0 ? height - 1 - i : i;
+        char* dst = base + ((size_t)y * width + first_x) * cell;
+        const char* src = base + ((size_t)(y + dy) * width + first_x + dx) * cell;
+        memmove(dst, src, row_bytes);
+    }
+}
+
+// reuse the last frame for a pan: shift its pixels, counts, glitch flags and which of them are final, then queue
+// the strips the pan exposed along with whatever the last frame didn't finish, one tile per chunk holding any
+static void start_pan(struct ThreadPool* tp, int dx, int dy) {
+    int width = tp->frame_vp.screen_width;
+    int height = tp->frame_vp.screen_height;
+
+    shift_grid(tp->frame.buffer, sizeof(Uint32), width, height, dx, dy);
+    shift_grid(tp->iterations, sizeof(int), width, height, dx, dy);
+    shift_grid(tp->final_pixels, 1, width, height, dx, dy);
+    if (tp->frame.precision == PRECISION_PERTURBATION) {
+        shift_grid(tp->perturb.glitched, 1, width, height, dx, dy);
+    }
+
+    int rows_start = dy > 0 ? height - dy : 0;
+    int rows_end = dy > 0 ? height : -dy;
+    int cols_start = dx > 0 ? width - dx : 0;
+    int cols_end = dx > 0 ? width : -dx;
+    for (int y = rows_start; y < rows_end; y++) {
+        memset(tp->final_pixels + (size_t)y * width, 0, width);
+    }
+    for (int y = 0; y < height; y++) {
+        memset(tp->final_pixels + (size_t)y * width + cols_start, 0, cols_end - cols_start);
+    }
+
+    // each chunk's tile is the bounding box of its pixels left to compute, so a thin strip stays thin; its coarse
+    // passes paint over the whole box, which is final again only once the tile is
+    int chunk = tp->tile_size > 0 ? tp->tile_size : DEFAULT_TILE_SIZE;
+    tp->pan_tile_count = 0;
+    for (int cy = 0; cy < height; cy += chunk) {
+        int cy_end = cy + chunk < height ? cy + chunk : height;
+        for (int cx = 0; cx < width; cx += chunk) {
+            int cx_end = cx + chunk < width ? cx + chunk : width;
+            int x0 = cx_end, x1 = cx, y0 = cy_end, y1 = cy;
+            for (int y = cy; y < cy_end; y++) {
+                const unsigned char* row = tp->final_pixels + (size_t)y * width;
+                for (int x = cx; x < cx_end; x++) {
+                    if (!row[x]) {
+                        x0 = x < x0 ? x : x0;
+                        x1 = x + 1 > x1 ? x + 1 : x1;
+                        y0 = y < y0 ? y : y0;
+                        y1 = y + 1;
+                    }
+                }
+            }
+            if (x0 < x1) {
+                tp->pan_tiles[tp->pan_tile_count++] = (struct RenderTile){.start_x = x0, .end_x = x1, .start_y = y0, .end_y = y1};
+                for (int y = y0; y < y1; y++) {
+                    memset(tp->final_pixels + (size_t)y * width + x0, 0, x1 - x0);
+                }
+            }
+        }
+    }
+    tp->frame_tiles = tp->pan_tiles;
+    tp->frame_tile_count = tp->pan_tile_count;
+}
+
+// a zoom of the finished frame, or a move that pan_offset() can't shift in place (into another buffer, or by part
+// of a pixel) resampled at scale 1: resample its counts as the pending frame's preview. the counts move to
+// previous_iterations, and the pending frame gets the other buffer
+static bool start_reprojection(struct ThreadPool* tp) {
+    const struct viewport* va = &tp->frame_vp;
+    const struct viewport* vb = &tp->pending_vp;
+    if (!reusable(tp)) {
+        return false;
+    }
+    double dx, dy;
+    centre_shift(tp, &dx, &dy);
+    if (va->zoom == vb->zoom && dx == 0.0 && dy == 0.0) {
+        return false;
+    }
+
+    struct Reprojection* r = &tp->reprojection;
+    r->width = va->screen_width;
+    r->height = va->screen_height;
+
+    // source position of pixel (x, y): ((centre_b - centre_a) / zoom_a) + half + (x - half) * scale
+    r->scale = vb->zoom / va->zoom;
+    r->x0 = dx + (va->screen_width / 2) * (1.0 - r->scale);
+    r->y0 = dy + (va->screen_height / 2) * (1.0 - r->scale);
+
+    // counts that reached the old limit are only known to this frame's if it doesn't go further;
+    // glitches the last frame couldn't fix, or different arithmetic, rule out reuse altogether
+    r->exact = tp->frame.precision == tp->pending.precision && !(tp->frame.perturb && tp->glitched_pixels > 0);
+    r->exact_limit = vb->iterations <= va->iterations ? INT_MAX : va->iterations;
+
+    int* source = tp->iterations;
+    tp->iterations = tp->previous_iterations;
+    tp->previous_iterations = source;
+    r->source = source;
+    return true;
+}
+
+// give each worker a contiguous run of tiles for the current pass; called with the pool lock held
+static void fill_queues(struct ThreadPool* tp) {
+    for (long w = 0; w < tp->count; w++) {
+        struct TileDeque* q = &tp->workers[w].queue;
+        int first = (int)(w * tp->frame_tile_count / tp->count);
+        int last = (int)((w + 1) * tp->frame_tile_count / tp->count);
+
+        pthread_mutex_lock(&q->lock);
+        // stored back to front so the owner pops its tiles in scan order
+        q->head = 0;
+        q->tail = 0;
+        for (int t = last - 1; t >= first; t--) {
+            q->tiles[q->tail++] = t;
+        }
+        q->frac = tp->pass_frac;
+        pthread_mutex_unlock(&q->lock);
+    }
+    tp->tiles_completed = 0;
+    if (tp->pass_frac != AA_DETECT_PASS && tp->pass_frac != AA_PASS && tp->pass_frac != ACCUMULATE_PASS) {
+        tp->glitched_pixels = 0;  // recounted by the pass, anti-aliasing and accumulation leave them as they were
+    }
+}
+
+static bool pop_tile(struct TileDeque* q, int* tile, int* frac) {
+    bool found = false;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        *tile = q->tiles[--q->tail];
+        *frac = q->frac;
+        found = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+static bool steal_tile(struct TileDeque* q, int* tile, int* frac) {
+    bool found = false;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        *tile = q->tiles[q->head++];
+        *frac = q->frac;
+        found = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+static bool next_tile(struct ThreadPool* tp, struct PoolWorker* worker, int* tile, int* frac) {
+    if (pop_tile(&worker->queue, tile, frac)) {
+        return true;
+    }
+    // own queue is empty, take from the far end of someone else's
+    for (long i = 1; i < tp->count; i++) {
+        long victim = (worker->index + i) % tp->count;
+        if (steal_tile(&tp->workers[victim].queue, tile, frac)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int first_pass(struct ThreadPool* tp) {
+    return tp->frame.start_render_frac < 1 ? 1 : tp->frame.start_render_frac;
+}
+
+// snapshot the pending frame and queue its first pass; called with the lock held once no worker is active
+static void start_generation(struct ThreadPool* tp) {
+    int pan_x, pan_y;
+    bool accumulate = accumulate_only(tp);
+    bool recolour = !accumulate && recolour_only(tp);
+    bool resume = !accumulate && !recolour && raise_only(tp);
+    bool pan = !accumulate && !recolour && !resume && pan_offset(tp, &pan_x, &pan_y);
+    bool reproject = !recolour && !resume && !pan && start_reprojection(tp);
+    int resume_limit = resume ? tp->frame_vp.iterations : 0;
+
+    tp->forget_frame = false;
+    tp->frame = tp->pending;
+    tp->frame_vp = tp->pending_vp;
+    tp->frame.vp = &tp->frame_vp;
+    tp->frame.generation_signal = &tp->generation;
+    tp->frame.generation = tp->generation;
+    tp->frame.iterations = tp->iterations;
+    tp->frame.reproject = reproject ? &tp->reprojection : NULL;
+    tp->frame.orbits = &tp->orbits;
+    tp->frame.resume_limit = resume_limit;
+    tp->frame.aa_reserved = &tp->aa_reserved;
+    if (tp->frame.aa_budget <= 0) {
+        tp->frame.aa_budget = tp->frame_vp.screen_width * tp->frame_vp.screen_height;
+    }
+    if (!accumulate && !recolour && !resume) {
+        reset_orbits(tp);
+    }
+    if (!accumulate && !recolour) {
+        tp->orbits.dropped = 0;
+    }
+    if (!accumulate && !pan) {
+        memset(tp->final_pixels, 0, (size_t)tp->frame_vp.screen_width * tp->frame_vp.screen_height);
+    }
+
+    tp->running_generation = tp->generation;
+    tp->pass_frac = accumulate ? ACCUMULATE_PASS
+                    : recolour ? RECOLOUR_PASS
+                    : resume   ? RESUME_PASS
+                    : reproject ? REPROJECT_PASS
+                               : first_pass(tp);
+    tp->frame_done = false;
+    tp->counts_final = accumulate;  // accumulation only changes the colours
+    tp->phase++;
+
+    // deep frames queue nothing until a worker has the reference orbit, recolouring and reprojection don't need
+    // one, and accumulation samples against the finished frame's
+    tp->frame.perturb = NULL;
+    tp->frame.fix_glitches = false;
+    tp->needs_reference = tp->frame.precision == PRECISION_PERTURBATION && !reproject && !recolour && !accumulate;
+    tp->preparing = false;
+    tp->have_reference = false;
+    tp->iterations_skipped = 0;
+    tp->counts = (struct IterationCounts){0};
+    tp->pixels_computed = 0;
+    tp->aa_edges = 0;
+    tp->aa_used = 0;
+    tp->aa_reserved = 0;
+
+    tp->frame_tiles = tp->tiles;
+    tp->frame_tile_count = tp->tile_count;
+    tp->mirror_start = tp->mirror_end = 0;
+    if (pan) {
+        start_pan(tp, pan_x, pan_y);
+    } else if (!accumulate) {
+        start_mirror(tp);
+    }
+
+    if (tp->frame.precision == PRECISION_PERTURBATION) {
+        tp->frame.perturb = &tp->perturb;
+    }
+    if (!tp->needs_reference) {
+        fill_queues(tp);
+    }
+
+    for (long i = 0; i < tp->count; i++) {
+        tp->workers[i].busy_ms = 0.0;
+    }
+
+    pthread_cond_broadcast(&tp->work_ready);
+}
+
+// the frame is at full resolution: anti-alias its edges when asked to, otherwise it's done; called with the lock held
+static void finish_frame(struct ThreadPool* tp) {
+    if (tp->frame.aa_samples <= 0) {
+        tp->frame_done = true;
+        mark_counts_final(tp);
+        return;
+    }
+    // no tiles are queued, so nothing reads frame while it changes. jittered samples aren't symmetric, every
+    // row takes its own
+    if (tp->mirror_end > tp->mirror_start) {
+        tp->frame_tiles = tp->tiles;
+        tp->frame_tile_count = tp->tile_count;
+        tp->mirror_start = tp->mirror_end = 0;
+    }
+    tp->frame.fix_glitches = false;
+    tp->pass_frac = AA_DETECT_PASS;
+    fill_queues(tp);
+}
+
+// called with the lock held when the last tile of a pass completes
+static void advance_pass(struct ThreadPool* tp) {
+    if (tp->pass_frac == ACCUMULATE_PASS) {
+        tp->frame_done = true;
+    } else if (tp->pass_frac == AA_PASS) {
+        tp->frame_done = true;
+        mark_counts_final(tp);
+    } else if (tp->pass_frac == AA_DETECT_PASS) {
+        // the budget spread evenly over the edges found
+        if (tp->aa_edges == 0) {
+            tp->frame_done = true;
+            mark_counts_final(tp);
+        } else {
+            double share = (double)tp->frame.aa_budget / (double)tp->aa_edges;
+            tp->frame.aa_share = share < tp->frame.aa_samples ? share : tp->frame.aa_samples;
+            tp->aa_edges = 0;  // counted again by the sampling pass
+            tp->pass_frac = AA_PASS;
+            fill_queues(tp);
+        }
+    } else if (tp->pass_frac == RECOLOUR_PASS || tp->pass_frac == RESUME_PASS) {
+        finish_frame(tp);
+    } else if (tp->pass_frac == REPROJECT_PASS) {
+        tp->pass_frac = first_pass(tp);
+        if (tp->frame.perturb) {
+            tp->needs_reference = true;
+        } else {
+            fill_queues(tp);
+        }
+    } else if (tp->pass_frac > 1) {
+        tp->pass_frac /= 2;
+        fill_queues(tp);
+    } else if (tp->frame.perturb && tp->glitched_pixels > 0 && tp->perturb.references < MAX_REFERENCES) {
+        tp->needs_reference = true;
+    } else {
+        finish_frame(tp);
+    }
+    tp->phase++;
+    pthread_cond_broadcast(&tp->work_ready);
+}
+
+// compute the frame's next reference orbit outside the lock; called with the lock held
+static void prepare_reference(struct ThreadPool* tp, int joined) {
+    bool rereference = tp->have_reference;
+    tp->preparing = true;
+    pthread_mutex_unlock(&tp->lock);
+
+    bool ok = perturbation_prepare(&tp->perturb, &tp->frame, rereference);
+
+    pthread_mutex_lock(&tp->lock);
+    tp->preparing = false;
+    if (tp->generation != joined) {
+        return;
+    }
+
+    // no tiles are queued, so nothing reads frame while it changes
+    tp->needs_reference = false;
+    if (ok) {
+        tp->have_reference = true;
+        tp->frame.fix_glitches = rereference;
+        fill_queues(tp);
+    } else if (rereference) {
+        finish_frame(tp);
+    } else {
+        tp->frame.perturb = NULL;  // no memory for an orbit, fall back to plain doubles
+        tp->frame.precision = PRECISION_DOUBLE;
+        fill_queues(tp);
+    }
+    tp->phase++;
+    pthread_cond_broadcast(&tp->work_ready);
+}
+
+static bool generation_finished(struct ThreadPool* tp) {
+    return tp->running_generation == tp->generation && tp->active == 0 && tp->frame_done;
+}
+
+static void run_tile(struct ThreadPool* tp, struct RenderJob* job, const struct RenderTile* tile, int frac) {
+    // keep per-worker scratch, take everything else from the frame
+    int* iteration_out = job->iteration_out;
+    Uint32* colour_out = job->colour_out;
+    struct OrbitState* orbit_out = job->orbit_out;
+    double* delta_out = job->delta_out;
+    unsigned char* glitch_out = job->glitch_out;
+    unsigned int* aa_sum = job->aa_sum;
+    unsigned char* aa_want = job->aa_want;
+    *job = tp->frame;
+    job->iteration_out = iteration_out;
+    job->colour_out = colour_out;
+    job->orbit_out = orbit_out;
+    job->delta_out = delta_out;
+    job->glitch_out = glitch_out;
+    job->aa_sum = aa_sum;
+    job->aa_want = aa_want;
+
+    job->start_x = tile->start_x;
+    job->end_x = tile->end_x;
+    job->start_y = tile->start_y;
+    job->end_y = tile->end_y;
+    job->start_render_frac = frac;
+    job->end_render_frac = frac;
+    job->coarse_render_frac = tp->frame.start_render_frac;
+
+    calculateMandelbrotRoutine(job);
+}
+
+// work through tiles until the frame is finished or a newer generation is posted
+static void render_generation(struct ThreadPool* tp, struct PoolWorker* worker, int joined) {
+    struct RenderJob* job = &tp->jobs[worker->index];
+
+    pthread_mutex_lock(&tp->lock);
+    while (tp->generation == joined && !tp->frame_done) {
+        int phase = tp->phase;
+        if (tp->needs_reference) {
+            if (!tp->preparing) {
+                prepare_reference(tp, joined);
+                continue;
+            }
+            while (tp->generation == joined && tp->phase == phase) {
+                pthread_cond_wait(&tp->work_ready, &tp->lock);
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&tp->lock);
+
+        int tile, frac;
+        if (next_tile(tp, worker, &tile, &frac)) {
+            struct timespec t0, t1;
+            timespec_get(&t0, TIME_UTC);
+            run_tile(tp, job, &tp->frame_tiles[tile], frac);
+            if (tp->mirror_end > tp->mirror_start) {
+                mirror_tile(tp, &tp->frame_tiles[tile]);
+            }
+            timespec_get(&t1, TIME_UTC);
+            worker->busy_ms += elapsed_ms(&t0, &t1);
+
+            pthread_mutex_lock(&tp->lock);
+            if (tp->generation == joined) {
+                tp->glitched_pixels += job->glitched_pixels;
+                tp->iterations_skipped += job->iterations_skipped;
+                tp->counts.iterations += job->counts.iterations;
+                tp->counts.lane_steps += job->counts.lane_steps;
+                tp->counts.inside += job->counts.inside;
+                tp->counts.periodic += job->counts.periodic;
+                tp->pixels_computed += job->pixels_computed;
+                tp->aa_edges += job->aa_edges;
+                tp->aa_used += job->aa_used;
+                // a tile's last pass, unless passes over the whole frame (glitch fixes, anti-aliasing) still follow
+                bool last_pass = frac == 1 || frac == RECOLOUR_PASS || frac == RESUME_PASS;
+                if (last_pass && !tp->frame.perturb && tp->frame.aa_samples <= 0) {
+                    mark_final(tp, &tp->frame_tiles[tile]);
+                }
+                if (++tp->tiles_completed == tp->frame_tile_count) {
+                    advance_pass(tp);
+                }
+            }
+            continue;
+        }
+
+        // nothing left to take, wait for the stragglers of this pass
+        pthread_mutex_lock(&tp->lock);
+        while (tp->generation == joined && !tp->frame_done && tp->phase == phase) {
+            pthread_cond_wait(&tp->work_ready, &tp->lock);
+        }
+    }
+    pthread_mutex_unlock(&tp->lock);
+}
+
+static void* worker_main(void* arg) {
+    struct PoolWorker* worker = (struct PoolWorker*)arg;
+    struct ThreadPool* tp = worker->pool;
+    int joined = 0;  // generation this worker last took part in
+
+    pthread_mutex_lock(&tp->lock);
+    while (true) {
+        // sleep until there is a generation this worker has not joined yet
+        while (!tp->shutdown && tp->running_generation == joined) {
+            if (tp->generation != tp->running_generation && tp->active == 0) {
+                // older frame has fully drained, safe to replace the snapshot
+                start_generation(tp);
+                break;
+            }
+            pthread_cond_wait(&tp->work_ready, &tp->lock);
+        }
+        if (tp->shutdown) {
+            break;
+        }
+
+        joined = tp->running_generation;
+        tp->active++;
+        pthread_mutex_unlock(&tp->lock);
+
+        render_generation(tp, worker, joined);
+
+        pthread_mutex_lock(&tp->lock);
+        tp->active--;
+        if (tp->active == 0) {
+            // either a newer generation can start, or a waiter can return
+            pthread_cond_broadcast(&tp->work_ready);
+            pthread_cond_broadcast(&tp->work_done);
+        }
+    }
+    pthread_mutex_unlock(&tp->lock);
+    return NULL;
+}
+
+static void stop_workers(struct ThreadPool* tp, long started) {
+    pthread_mutex_lock(&tp->lock);
+    tp->shutdown = true;
+    tp->generation++;
+    pthread_cond_broadcast(&tp->work_ready);
+    pthread_mutex_unlock(&tp->lock);
+
+    for (long i = 0; i < started; i++) {
+        pthread_join(tp->threads[i], NULL);
+    }
+}
+
+int thread_pool_init(struct ThreadPool* tp, long count, int scrn_width, int scrn_height, int tile_size) {
+    tp->count = count;
+    tp->started = 0;
+    tp->tile_size = tile_size;
+    tp->tiles = NULL;
+    tp->tile_count = 0;
+    tp->pan_tiles = NULL;
+    tp->pan_tile_count = 0;
+    tp->final_pixels = NULL;
+    tp->frame_tiles = NULL;
+    tp->frame_tile_count = 0;
+    tp->mirror_axis = 0;
+    tp->mirror_start = 0;
+    tp->mirror_end = 0;
+    tp->generation = 0;
+    tp->running_generation = 0;
+    tp->active = 0;
+    tp->pass_frac = 1;
+    tp->tiles_completed = 0;
+    tp->phase = 0;
+    tp->frame_done = true;
+    tp->counts_final = false;
+    tp->forget_frame = false;
+    tp->shutdown = false;
+    tp->needs_reference = false;
+    tp->preparing = false;
+    tp->have_reference = false;
+    tp->glitched_pixels = 0;
+    tp->iterations_skipped = 0;
+    tp->counts = (struct IterationCounts){0};
+    tp->pixels_computed = 0;
+    tp->aa_edges = 0;
+    tp->aa_used = 0;
+    tp->aa_reserved = 0;
+
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->work_ready, NULL);
+    pthread_cond_init(&tp->work_done, NULL);
+
+    tp->threads = calloc(count, sizeof(pthread_t));
+    tp->workers = calloc(count, sizeof(struct PoolWorker));
+    tp->jobs = calloc(count, sizeof(struct RenderJob));
+    tp->iterations = malloc((size_t)scrn_width * scrn_height * sizeof(int));
+    tp->previous_iterations = malloc((size_t)scrn_width * scrn_height * sizeof(int));
+    tp->reprojection.kind = malloc((size_t)scrn_width * scrn_height);
+    tp->final_pixels = calloc((size_t)scrn_width * scrn_height, 1);
+    tp->orbits.capacity = (int)(ORBIT_STORE_BYTES / sizeof(struct OrbitState));
+    if ((size_t)tp->orbits.capacity > (size_t)scrn_width * scrn_height) {
+        tp->orbits.capacity = scrn_width * scrn_height;
+    }
+    tp->orbits.slot = malloc((size_t)scrn_width * scrn_height * sizeof(int));
+    tp->orbits.states = malloc((size_t)tp->orbits.capacity * sizeof(struct OrbitState));
+    tp->orbits.used = 0;
+    tp->orbits.dropped = 0;
+    int perturb_failed = perturbation_init(&tp->perturb, scrn_width, scrn_height);
+    if (!tp->threads || !tp->workers || !tp->jobs || !tp->iterations || !tp->previous_iterations || !tp->reprojection.kind || !tp->final_pixels || !tp->orbits.slot || !tp->orbits.states || perturb_failed || build_tiles(tp, scrn_width, scrn_height) != 0) {
+        fprintf(stderr, "Failed to allocate render data\n");
+        thread_pool_destroy(tp);
+        return 1;
+    }
+
+    int pan_capacity = pan_tile_capacity(tp, scrn_width, scrn_height);
+    tp->pan_tiles = calloc(pan_capacity, sizeof(struct RenderTile));
+    if (!tp->pan_tiles) {
+        fprintf(stderr, "Failed to allocate render data\n");
+        thread_pool_destroy(tp);
+        return 1;
+    }
+
+    // a worker's queue never holds more than its initial share of a pass
+    int most_tiles = pan_capacity > tp->tile_count ? pan_capacity : tp->tile_count;
+    int queue_capacity = (int)((most_tiles + count - 1) / count);
+    // span scratch holds a row, or a column of a Mariani-Silver border
+    int longest_span = scrn_width > scrn_height ? scrn_width : scrn_height;
+
+    for (long i = 0; i < count; i++) {
+        tp->workers[i].queue.tiles = malloc(queue_capacity * sizeof(int));
+        if (tp->workers[i].queue.tiles) {
+            pthread_mutex_init(&tp->workers[i].queue.lock, NULL);
+        }
+        tp->jobs[i].iteration_out = malloc(longest_span * sizeof(int));
+        tp->jobs[i].colour_out = malloc(scrn_width * sizeof(Uint32));
+        tp->jobs[i].orbit_out = malloc(longest_span * sizeof(struct OrbitState));
+        tp->jobs[i].delta_out = malloc(longest_span * sizeof(double));
+        tp->jobs[i].glitch_out = malloc(longest_span);
+        tp->jobs[i].aa_sum = malloc(scrn_width * 4 * sizeof(unsigned int));
+        tp->jobs[i].aa_want = malloc(scrn_width);
+        if (!tp->workers[i].queue.tiles || !tp->jobs[i].iteration_out || !tp->jobs[i].colour_out || !tp->jobs[i].orbit_out || !tp->jobs[i].delta_out || !tp->jobs[i].glitch_out || !tp->jobs[i].aa_sum || !tp->jobs[i].aa_want) {
+            fprintf(stderr, "Failed to allocate iter_scratch\n");
+            thread_pool_destroy(tp);
+            return 1;
+        }
+    }
+
+    for (long i = 0; i < count; i++) {
+        tp->workers[i].pool = tp;
+        tp->workers[i].index = (int)i;
+        if (pthread_create(&tp->threads[i], NULL, worker_main, &tp->workers[i]) != 0) {
+            fprintf(stderr, "Failed to start render thread\n");
+            thread_pool_destroy(tp);
+            return 1;
+        }
+        tp->started = i + 1;
+    }
+
+    return 0;
+}
+
+void thread_pool_render(struct ThreadPool* tp, const struct RenderJob* frame) {
+    pthread_mutex_lock(&tp->lock);
+    tp->pending = *frame;
+    tp->pending_vp = *frame->vp;
+    tp->generation++;  // running workers see this and bail out
+
+    // pool may already be idle, in which case start immediately
+    if (tp->active == 0) {
+        start_generation(tp);
+    } else {
+        pthread_cond_broadcast(&tp->work_ready);
+    }
+    pthread_mutex_unlock(&tp->lock);
+}
+
+void thread_pool_reset_reuse(struct ThreadPool* tp) {
+    pthread_mutex_lock(&tp->lock);
+    tp->forget_frame = true;
+    pthread_mutex_unlock(&tp->lock);
+}
+
+void thread_pool_wait(struct ThreadPool* tp) {
+    pthread_mutex_lock(&tp->lock);
+    while (!generation_finished(tp)) {
+        pthread_cond_wait(&tp->work_done, &tp->lock);
+    }
+    pthread_mutex_unlock(&tp->lock);
+}
+
+bool thread_pool_finished(struct ThreadPool* tp) {
+    pthread_mutex_lock(&tp->lock);
+    bool finished = generation_finished(tp);
+    pthread_mutex_unlock(&tp->lock);
+    return finished;
+}
+
+void thread_pool_load_balance(struct ThreadPool* tp, double* max_ms, double* mean_ms) {
+    double max = 0.0;
+    double sum = 0.0;
+
+    pthread_mutex_lock(&tp->lock);
+    for (long i = 0; i < tp->count; i++) {
+        double busy = tp->workers[i].busy_ms;
+        sum += busy;
+        max = busy > max ? busy : max;
+    }
+    pthread_mutex_unlock(&tp->lock);
+
+    *max_ms = max;
+    *mean_ms = tp->count > 0 ? sum / (double)tp->count : 0.0;
+}
+
+void thread_pool_perturbation_stats(struct ThreadPool* tp, int* references, int* glitched_pixels, long long* iterations_skipped) {
+    pthread_mutex_lock(&tp->lock);
+    *references = tp->frame.perturb ? tp->perturb.references : 0;
+    *glitched_pixels = tp->frame.perturb ? tp->glitched_pixels : 0;
+    *iterations_skipped = tp->iterations_skipped;
+    pthread_mutex_unlock(&tp->lock);
+}
+
+double thread_pool_computed_fraction(struct ThreadPool* tp) {
+    pthread_mutex_lock(&tp->lock);
+    double pixels = (double)tp->frame_vp.screen_width * tp->frame_vp.screen_height;
+    double fraction = pixels > 0.0 ? (double)tp->pixels_computed / pixels : 0.0;
+    pthread_mutex_unlock(&tp->lock);
+    return fraction;
+}
+
+void thread_pool_iteration_counts(struct ThreadPool* tp, struct IterationCounts* counts) {
+    pthread_mutex_lock(&tp->lock);
+    *counts = tp->counts;
+    pthread_mutex_unlock(&tp->lock);
+}
+
+void thread_pool_orbit_stats(struct ThreadPool* tp, int* saved, int* dropped, size_t* bytes) {
+    pthread_mutex_lock(&tp->lock);
+    int used = tp->orbits.used;
+    *saved = used < tp->orbits.capacity ? used : tp->orbits.capacity;
+    *dropped = tp->orbits.dropped;
+    *bytes = (size_t)tp->orbits.capacity * sizeof(struct OrbitState) +
+             (size_t)tp->frame_vp.screen_width * tp->frame_vp.screen_height * sizeof(int);
+    pthread_mutex_unlock(&tp->lock);
+}
+
+void thread_pool_aa_stats(struct ThreadPool* tp, long long* edges, long long* samples) {
+    pthread_mutex_lock(&tp->lock);
+    *edges = tp->aa_edges;
+    *samples = tp->aa_used;
+    pthread_mutex_unlock(&tp->lock);
+}
+
+// only valid after thread_pool_init(), including when it failed
+void thread_pool_destroy(struct ThreadPool* tp) {
+    stop_workers(tp, tp->started);
+
+    if (tp->jobs != NULL) {
+        for (long i = 0; i < tp->count; i++) {
+            free(tp->jobs[i].iteration_out);
+            free(tp->jobs[i].colour_out);
+            free(tp->jobs[i].orbit_out);
+            free(tp->jobs[i].delta_out);
+            free(tp->jobs[i].glitch_out);
+            free(tp->jobs[i].aa_sum);
+            free(tp->jobs[i].aa_want);
+        }
+    }
+    if (tp->workers != NULL) {
+        for (long i = 0; i < tp->count; i++) {
+            if (tp->workers[i].queue.tiles != NULL) {
+                pthread_mutex_destroy(&tp->workers[i].queue.lock);
+                free(tp->workers[i].queue.tiles);
+            }
+        }
+    }
+
+    perturbation_free(&tp->perturb);
+    free(tp->iterations);
+    free(tp->previous_iterations);
+    free(tp->reprojection.kind);
+    free(tp->final_pixels);
+    free(tp->orbits.slot);
+    free(tp->orbits.states);
+    free(tp->tiles);
+    free(tp->pan_tiles);
+    free(tp->jobs);
+    free(tp->workers);
+    free(tp->threads);
+    tp->tiles = NULL;
+    tp->pan_tiles = NULL;
+    tp->frame_tiles = NULL;
+    tp->iterations = NULL;
+    tp->previous_iterations = NULL;
+    tp->reprojection.kind = NULL;
+    tp->final_pixels = NULL;
+    tp->orbits.slot = NULL;
+    tp->orbits.states = NULL;
+    tp->jobs = NULL;
+    tp->workers = NULL;
+    tp->threads = NULL;
+    tp->count = 0;
+    tp->started = 0;
+
+    pthread_cond_destroy(&tp->work_done);
+    pthread_cond_destroy(&tp->work_ready);
+    pthread_mutex_destroy(&tp->lock);
+}
@@ -0,0 +1,269 @@
+#ifndef _WIN32
+// ftruncate and msync are POSIX, and the file can be larger than a 32 bit off_t
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "tiled_image.h"
+
+#include "image_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint64_t tile_bytes(const struct TiledHeader* h) {
+    return (uint64_t)h->tile_size * h->tile_size * sizeof(Uint32);
+}
+
+static uint64_t file_bytes(const struct TiledHeader* h) {
+    return h->data_offset + (uint64_t)h->tiles_x * h->tiles_y * tile_bytes(h);
+}
+
+static bool layout(struct TiledHeader* h, int width, int height, int tile_size, uint64_t key) {
+    if (width <= 0 || height <= 0 || tile_size <= 0) {
+        return false;
+    }
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, TILED_MAGIC, sizeof(h->magic));
+    h->width = (uint32_t)width;
+    h->height = (uint32_t)height;
+    h->tile_size = (uint32_t)align_up((uint64_t)tile_size, TILED_TILE_MULTIPLE);
+    h->tiles_x = (h->width + h->tile_size - 1) / h->tile_size;
+    h->tiles_y = (h->height + h->tile_size - 1) / h->tile_size;
+    h->key = key;
+    h->data_offset = align_up(TILED_HEADER_BYTES + (uint64_t)h->tiles_x * h->tiles_y, TILED_ALIGN);
+    return (uint64_t)h->tiles_x * h->tiles_y <= 0x7FFFFFFF;
+}
+
+static bool valid(const struct TiledHeader* h, uint64_t size) {
+    return memcmp(h->magic, TILED_MAGIC, sizeof(h->magic)) == 0 && h->tile_size > 0 && h->tile_size % TILED_TILE_MULTIPLE == 0 &&
+           h->tiles_x == (h->width + h->tile_size - 1) / h->tile_size && h->tiles_y == (h->height + h->tile_size - 1) / h->tile_size &&
+           (uint64_t)h->tiles_x * h->tiles_y <= 0x7FFFFFFF && h->data_offset >= TILED_HEADER_BYTES + (uint64_t)h->tiles_x * h->tiles_y &&
+           file_bytes(h) == size;
+}
+
+// create_size 0 only opens an existing file
+#ifdef _WIN32
+
+static bool map_file(struct TiledImage* image, const char* path, uint64_t create_size, uint64_t* size) {
+    DWORD disposition = create_size > 0 ? OPEN_ALWAYS : OPEN_EXISTING;
+    image->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (image->file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER existing;
+    if (!GetFileSizeEx(image->file, &existing)) {
+        CloseHandle(image->file);
+        return false;
+    }
+    // a mapping larger than the file extends it with zeros
+    *size = existing.QuadPart == 0 ? create_size : (uint64_t)existing.QuadPart;
+    if (*size == 0 || *size > SIZE_MAX) {
+        CloseHandle(image->file);
+        return false;
+    }
+    image->mapping = CreateFileMappingA(image->file, NULL, PAGE_READWRITE, (DWORD)(*size >> 32), (DWORD)*size, NULL);
+    image->base = image->mapping ? MapViewOfFile(image->mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)*size) : NULL;
+    if (!image->base) {
+        if (image->mapping) {
+            CloseHandle(image->mapping);
+        }
+        CloseHandle(image->file);
+        return false;
+    }
+    return true;
+}
+
+static int flush_range(struct TiledImage* image, void* start, size_t bytes) {
+    return FlushViewOfFile(start, bytes) && FlushFileBuffers(image->file) ? 0 : 1;
+}
+
+static int unmap_file(struct TiledImage* image) {
+    int status = UnmapViewOfFile(image->base) ? 0 : 1;
+    CloseHandle(image->mapping);
+    CloseHandle(image->file);
+    return status;
+}
+
+#else
+
+static bool map_file(struct TiledImage* image, const char* path, uint64_t create_size, uint64_t* size) {
+    image->fd = open(path, create_size > 0 ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if (image->fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(image->fd, &st) != 0) {
+        close(image->fd);
+        return false;
+    }
+    // a new file is grown to full size at once; the filesystem keeps it sparse until tiles are written
+    *size = st.st_size == 0 ? create_size : (uint64_t)st.st_size;
+    if (*size == 0 || *size > SIZE_MAX || (st.st_size == 0 && ftruncate(image->fd, (off_t)*size) != 0)) {
+        close(image->fd);
+        return false;
+    }
+    image->base = mmap(NULL, (size_t)*size, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0);
+    if (image->base == MAP_FAILED) {
+        image->base = NULL;
+        close(image->fd);
+        return false;
+    }
+    return true;
+}
+
+static int flush_range(struct TiledImage* image, void* start, size_t bytes) {
+    // msync wants a page aligned start
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t offset = (size_t)((unsigned char*)start - image->base) % page;
+    return msync((unsigned char*)start - offset, bytes + offset, MS_SYNC) == 0 ? 0 : 1;
+}
+
+static int unmap_file(struct TiledImage* image) {
+    int status = munmap(image->base, image->size) == 0 ? 0 : 1;
+    if (close(image->fd) != 0) {
+        status = 1;
+    }
+    return status;
+}
+
+#endif
+
+static struct TiledImage* map_image(const char* path, const struct TiledHeader* want) {
+    struct TiledImage* image = calloc(1, sizeof(struct TiledImage));
+    if (!image) {
+        fprintf(stderr, "tiles: allocation failed\n");
+        return NULL;
+    }
+
+    uint64_t size;
+    if (!map_file(image, path, want ? file_bytes(want) : 0, &size)) {
+        fprintf(stderr, "tiles: can't map %s\n", path);
+        free(image);
+        return NULL;
+    }
+    image->size = (size_t)size;
+
+    // a file this render just created is all zeros
+    struct TiledHeader* header = (struct TiledHeader*)image->base;
+    bool created = want && memcmp(header->magic, "\0\0\0\0\0\0\0\0", sizeof(header->magic)) == 0 && size == file_bytes(want);
+    if (created) {
+        *header = *want;
+    }
+
+    if (size < sizeof(struct TiledHeader) || !valid(header, size)) {
+        fprintf(stderr, "tiles: %s isn't a tiled image\n", path);
+        unmap_file(image);
+        free(image);
+        return NULL;
+    }
+    if (want && (header->width != want->width || header->height != want->height || header->tile_size != want->tile_size ||
+                 header->key != want->key)) {
+        fprintf(stderr, "tiles: %s holds a different render, remove it to start again\n", path);
+        unmap_file(image);
+        free(image);
+        return NULL;
+    }
+
+    image->header = *header;
+    image->done = image->base + TILED_HEADER_BYTES;
+    image->tile_count = (int)(header->tiles_x * header->tiles_y);
+    image->tiles_done = 0;
+    for (int t = 0; t < image->tile_count; t++) {
+        image->tiles_done += image->done[t] == 1;
+    }
+    return image;
+}
+
+struct TiledImage* tiled_open(const char* path, int width, int height, int tile_size, uint64_t key) {
+    struct TiledHeader want;
+    if (!layout(&want, width, height, tile_size, key)) {
+        fprintf(stderr, "tiles: invalid layout %dx%d in tiles of %d\n", width, height, tile_size);
+        return NULL;
+    }
+    return map_image(path, &want);
+}
+
+struct TiledImage* tiled_open_existing(const char* path) {
+    return map_image(path, NULL);
+}
+
+Uint32* tiled_tile(struct TiledImage* image, int tile) {
+    return (Uint32*)(image->base + image->header.data_offset + (uint64_t)tile * tile_bytes(&image->header));
+}
+
+int tiled_finish_tile(struct TiledImage* image, int tile) {
+    // the pixels reach the disk before the mark does, so a render cut short never trusts a torn tile
+    if (flush_range(image, tiled_tile(image, tile), (size_t)tile_bytes(&image->header)) != 0) {
+        fprintf(stderr, "tiles: flushing tile %d failed\n", tile);
+        return 1;
+    }
+    if (image->done[tile] != 1) {
+        image->done[tile] = 1;
+        image->tiles_done++;
+    }
+    return flush_range(image, image->done + tile, 1);
+}
+
+int tiled_close(struct TiledImage* image) {
+    int status = unmap_file(image);
+    if (status != 0) {
+        fprintf(stderr, "tiles: closing the mapping failed\n");
+    }
+    free(image);
+    return status;
+}
+
+int tiled_export(const char* path, const char* output) {
+    struct TiledImage* image = tiled_open_existing(path);
+    if (!image) {
+        return 1;
+    }
+    if (image->tiles_done < image->tile_count) {
+        fprintf(stderr, "tiles: %s has %d of %d tiles, finish the render first\n", path, image->tiles_done, image->tile_count);
+        tiled_close(image);
+        return 1;
+    }
+
+    const struct TiledHeader* h = &image->header;
+    Uint32* row = malloc((size_t)h->width * sizeof(Uint32));
+    struct ImageWriter* writer = row ? image_open(output, (int)h->width, (int)h->height) : NULL;
+    if (!writer) {
+        free(row);
+        tiled_close(image);
+        return 1;
+    }
+
+    // each output row gathers one row from every tile across
+    int status = 0;
+    for (uint32_t y = 0; y < h->height && status == 0; y++) {
+        uint32_t ty = y / h->tile_size;
+        uint32_t in_tile = y % h->tile_size;
+        for (uint32_t tx = 0; tx < h->tiles_x; tx++) {
+            uint32_t x0 = tx * h->tile_size;
+            uint32_t count = h->width - x0 < h->tile_size ? h->width - x0 : h->tile_size;
+            const Uint32* src = tiled_tile(image, (int)(ty * h->tiles_x + tx)) + (size_t)in_tile * h->tile_size;
+            memcpy(row + x0, src, count * sizeof(Uint32));
+        }
+        status = image_write_rows(writer, row, 1);
+    }
+
+    if (image_close(writer) != 0) {
+        status = 1;
+    }
+    free(row);
+    tiled_close(image);
+    return status;
+}